@@ -954,16 +954,26 @@ get_window_rule(xcb_window_t win)
 	xcb_get_property_cookie_t cn = xcb_icccm_get_wm_class(wm->connection, win);
 	const uint8_t			  wr =
 		xcb_icccm_get_wm_class_reply(wm->connection, cn, &t_reply, NULL);
-	if (wr == 1) {
-		rule_t *current = rule_head;
-		while (current) {
-			if (strcasecmp(current->win_name, t_reply.class_name) == 0) {
-				xcb_icccm_get_wm_class_reply_wipe(&t_reply);
-				return current;
-			}
-			current = current->next;
+	if (wr != 1) {
+		return NULL;
+	}
+	rule_t *rule = find_window_rule(t_reply.class_name);
+	xcb_icccm_get_wm_class_reply_wipe(&t_reply);
+	return rule;
+}
+
+rule_t *
+find_window_rule(const char *class_name)
+{
+	if (class_name == NULL || class_name[0] == '\0') {
+		return NULL;
+	}
+	rule_t *current = rule_head;
+	while (current) {
+		if (strcasecmp(current->win_name, class_name) == 0) {
+			return current;
 		}
-		xcb_icccm_get_wm_class_reply_wipe(&t_reply);
+		current = current->next;
 	}
 	return NULL;
 }
@@ -1041,6 +1051,33 @@ parse_config_line(char *key, char *value, config_t *c, bool reload)
 			_LOG_(ERROR, "invalid value for focus_follow_spawn: %s", value);
 			return -1;
 		}
+	} else if (strcmp(key, "atomic_transitions") == 0) {
+		if (strcmp(value, "true") == 0) {
+			c->atomic_transitions = true;
+		} else if (strcmp(value, "false") == 0) {
+			c->atomic_transitions = false;
+		} else {
+			_LOG_(ERROR, "invalid value for atomic_transitions: %s", value);
+			return -1;
+		}
+	} else if (strcmp(key, "outline_mode") == 0) {
+		if (strcmp(value, "true") == 0) {
+			c->outline_mode = true;
+		} else if (strcmp(value, "false") == 0) {
+			c->outline_mode = false;
+		} else {
+			_LOG_(ERROR, "invalid value for outline_mode: %s", value);
+			return -1;
+		}
+	} else if (strcmp(key, "drag_overlay") == 0) {
+		if (strcmp(value, "true") == 0) {
+			c->drag_overlay = true;
+		} else if (strcmp(value, "false") == 0) {
+			c->drag_overlay = false;
+		} else {
+			_LOG_(ERROR, "invalid value for drag_overlay: %s", value);
+			return -1;
+		}
 	} else if (strcmp(key, "rule") == 0) {
 		rule_t *rule = init_rule();
 		if (rule == NULL) {
@@ -38,6 +38,7 @@ extern conf_key_t *key_head;
 
 /* clang-format off */
 rule_t *get_window_rule(xcb_window_t win);
+rule_t *find_window_rule(const char *class_name);
 int load_config(config_t *c);
 void free_keys(void);
 void free_rules(void);
@@ -33,41 +33,33 @@
 #include <xcb/xcb.h>
 
 #include "helper.h"
+#include "outline.h"
+#include "spatial.h"
 #include "tree.h"
 #include "type.h"
+#include "winmap.h"
 #include "zwm.h"
 
 drag_state_t drag_state = {0};
+/* preview layouts computed during the current drag, one entry per target.
+ * the buffers are kept across drags, only emptied */
+static preview_rect_t  *preview_rects	= NULL;
+static size_t			preview_len		= 0;
+static size_t			preview_cap		= 0;
+static preview_entry_t *preview_entries = NULL;
+static size_t			preview_n		= 0;
+static size_t			preview_n_cap	= 0;
+/* entry whose layout is on screen, if preview_active */
+static size_t			preview_shown	= 0;
+/* windows managed when the layouts were computed */
+static uint32_t			preview_version = 0;
 /* clang-format off */
-static void apply_preview_layout(node_t *root);
-static void preview_restore_layout(void);
 static void preview_apply(node_t *target);
 static void preview_clear(void);
+static void preview_reset(void);
+static preview_entry_t *preview_lookup(node_t *t);
 /* clang-format on */
 
-static void
-apply_preview_layout(node_t *root)
-{
-	if (!root)
-		return;
-
-	if (!IS_INTERNAL(root) && root->client) {
-		if (IS_FULLSCREEN(root->client))
-			return;
-		if (root->client->window != drag_state.window) {
-			const rectangle_t r = IS_FLOATING(root->client)
-									  ? root->floating_rectangle
-									  : root->rectangle;
-			resize_window(root->client->window, r.width, r.height);
-			move_window(root->client->window, r.x, r.y);
-		}
-		return;
-	}
-
-	apply_preview_layout(root->first_child);
-	apply_preview_layout(root->second_child);
-}
-
 /* starts the drag session */
 int
 drag_start(xcb_window_t win, int16_t x, int16_t y, bool kbd)
@@ -102,12 +94,11 @@ drag_start(xcb_window_t win, int16_t x, int16_t y, bool kbd)
 	 * to revert on cancel or error */
 	drag_state.original_desktop = curr_monitor->desk;
 	drag_state.original_rect	= n->rectangle;
+	preview_reset();
 
 	/* pop the window to the top layer so it doesn't get covered.
 	 * dragged windows are always on top */
-	const uint32_t val[]		= {XCB_STACK_MODE_ABOVE};
-	xcb_configure_window(
-		wm->connection, win, XCB_CONFIG_WINDOW_STACK_MODE, val);
+	raise_window(win);
 
 	/* xcb_change_window_attributes(wm->connection,
 	 * 							 wm->root_window,
@@ -149,8 +140,37 @@ drag_move(int16_t x, int16_t y)
 	drag_state.cur_y = y;
 
 	/* figure out which partition is under the cursor */
-	node_t *root	 = curr_monitor->desk->tree;
-	node_t *target	 = find_leaf_at_point(root, x, y);
+	node_t *target = spatial_leaf_at(curr_monitor->desk, x, y);
+
+	/* center the window on the cursor */
+	rectangle_t r = drag_state.original_rect;
+	r.x			  = x - (drag_state.original_rect.width / 2);
+	r.y			  = y - (drag_state.original_rect.height / 2);
+
+	if (conf.drag_overlay) {
+		/* no live preview, show where the window would land and leave every
+		 * client alone until the drop */
+		drag_state.last_target =
+			(target && target != drag_state.src_node) ? target : NULL;
+		preview_entry_t *e =
+			drag_state.last_target ? preview_lookup(drag_state.last_target)
+								   : NULL;
+		if (e)
+			drop_zone_show(e->src);
+		else
+			drop_zone_hide();
+		return 0;
+	}
+
+	if (conf.outline_mode) {
+		/* no live preview, frame the drop target (or the window itself) and
+		 * leave every client alone until the drop */
+		drag_state.last_target =
+			(target && target != drag_state.src_node) ? target : NULL;
+		outline_show(drag_state.last_target ? drag_state.last_target->rectangle
+											: r);
+		return 0;
+	}
 
 	if (!target || target == drag_state.src_node) {
 		if (drag_state.last_target) {
@@ -163,10 +183,7 @@ drag_move(int16_t x, int16_t y)
 		drag_state.last_target = drag_state.preview_active ? target : NULL;
 	}
 
-	/* center the window on the cursor */
-	int16_t new_x = x - (drag_state.original_rect.width / 2);
-	int16_t new_y = y - (drag_state.original_rect.height / 2);
-	move_window(drag_state.window, new_x, new_y);
+	commit_client_geometry(drag_state.src_node->client, r, conf.border_width);
 
 	return 0;
 }
@@ -178,9 +195,10 @@ drag_end(int16_t x, int16_t y)
 	if (!drag_state.active)
 		return 0;
 
-	node_t *root   = curr_monitor->desk->tree;
-	node_t *target = find_leaf_at_point(root, x, y);
+	node_t *target = spatial_leaf_at(curr_monitor->desk, x, y);
 
+	drop_zone_hide();
+	outline_hide();
 	preview_clear();
 	drag_state.last_target = NULL;
 
@@ -224,6 +242,8 @@ drag_cancel(void)
 
 	_LOG_(INFO, "drag cancelled");
 
+	drop_zone_hide();
+	outline_hide();
 	preview_clear();
 	drag_state.last_target = NULL;
 
@@ -273,57 +293,134 @@ start_keyboard_drag_wrapper(arg_t *arg)
 	return drag_start(n->client->window, cx, cy, true);
 }
 
-static void
-preview_restore_layout(void)
+static inline bool
+rect_equal(rectangle_t a, rectangle_t b)
 {
-	arrange_tree(curr_monitor->desk->tree, curr_monitor->desk->layout);
-	render_tree_nomap(curr_monitor->desk->tree);
+	return a.x == b.x && a.y == b.y && a.width == b.width &&
+		   a.height == b.height;
+}
+
+/* the tiled window behind a preview rect, if it is still there */
+static node_t *
+preview_node(const preview_rect_t *pr)
+{
+	winmap_entry_t *e = winmap_get(pr->window);
+	if (e == NULL || e->node == NULL || e->node->client == NULL)
+		return NULL;
+	if (IS_FLOATING(e->node->client) || IS_FULLSCREEN(e->node->client))
+		return NULL;
+	return e->node;
 }
 
 static void
-preview_apply(node_t *t)
+collect_preview_rect(const node_t *n, void *arg)
 {
-	if (!t || !t->client)
+	if (n->client->window == drag_state.window) {
+		*(rectangle_t *)arg = n->rectangle;
 		return;
-
-	node_t *r = curr_monitor->desk->tree;
-	if (!r)
+	}
+	if (IS_FLOATING(n->client) || IS_FULLSCREEN(n->client))
 		return;
 
-	node_t *pr = clone_tree(r, NULL);
-	if (!pr)
-		return;
+	if (preview_len == preview_cap) {
+		size_t			nc = preview_cap ? preview_cap * 2 : 32;
+		preview_rect_t *r  = realloc(preview_rects, nc * sizeof(*r));
+		if (r == NULL)
+			return;
+		preview_rects = r;
+		preview_cap	  = nc;
+	}
+	preview_rects[preview_len++] =
+		(preview_rect_t){.window = n->client->window, .rect = n->rectangle};
+}
 
-	desktop_t desk = {0};
-	desk.tree	   = pr;
-	desk.layout	   = curr_monitor->desk->layout;
+/* returns the memoized layout for dropping on t, computing it the first
+ * time t is hovered */
+static preview_entry_t *
+preview_lookup(node_t *t)
+{
+	/* a window came or went mid drag, every layout is stale. callers never
+	 * look up with a preview on screen */
+	if (preview_version != winmap_version())
+		preview_reset();
+
+	for (size_t i = 0; i < preview_n; i++) {
+		if (preview_entries[i].target == t->client->window)
+			return &preview_entries[i];
+	}
 
-	node_t *ps	   = find_node_by_window_id(pr, drag_state.window);
-	node_t *pt	   = find_node_by_window_id(pr, t->client->window);
-	if (!ps || !pt || ps == pt) {
-		free_tree(pr);
-		return;
+	if (preview_n == preview_n_cap) {
+		size_t			 nc = preview_n_cap ? preview_n_cap * 2 : 8;
+		preview_entry_t *e	= realloc(preview_entries, nc * sizeof(*e));
+		if (e == NULL)
+			return NULL;
+		preview_entries = e;
+		preview_n_cap	= nc;
 	}
 
-	if (!unlink_node(ps, &desk)) {
-		free_tree(desk.tree);
-		return;
+	const size_t first = preview_len;
+	rectangle_t	 src   = drag_state.original_rect;
+	if (!layout_as_moved(curr_monitor->desk,
+						 drag_state.src_node,
+						 t,
+						 collect_preview_rect,
+						 &src)) {
+		preview_len = first;
+		return NULL;
 	}
+	preview_entry_t *e = &preview_entries[preview_n++];
+	e->target		   = t->client->window;
+	e->first		   = first;
+	e->count		   = preview_len - first;
+	e->src			   = src;
+	return e;
+}
 
-	insert_node(pt, ps, desk.layout);
-	arrange_tree(desk.tree, desk.layout);
-	apply_preview_layout(desk.tree);
-	free_tree(desk.tree);
+/* moves the windows whose preview rectangle differs from the live one */
+static void
+preview_apply(node_t *t)
+{
+	if (!t || !t->client || !curr_monitor->desk->tree)
+		return;
+
+	preview_entry_t *e = preview_lookup(t);
+	if (e == NULL)
+		return;
+
+	for (size_t i = e->first; i < e->first + e->count; i++) {
+		node_t *live = preview_node(&preview_rects[i]);
+		if (live && !rect_equal(live->rectangle, preview_rects[i].rect))
+			commit_client_geometry(
+				live->client, preview_rects[i].rect, conf.border_width);
+	}
 
+	preview_shown			  = (size_t)(e - preview_entries);
 	drag_state.preview_active = true;
 }
 
+/* puts back only the windows the shown preview moved */
 static void
 preview_clear(void)
 {
 	if (!drag_state.preview_active)
 		return;
 
-	preview_restore_layout();
+	const preview_entry_t *e = &preview_entries[preview_shown];
+	for (size_t i = e->first; i < e->first + e->count; i++) {
+		node_t *live = preview_node(&preview_rects[i]);
+		if (live && !rect_equal(live->rectangle, preview_rects[i].rect))
+			commit_client_geometry(
+				live->client, live->rectangle, conf.border_width);
+	}
+	drag_state.preview_active = false;
+}
+
+/* forgets the memoized layouts, they only hold for one drag */
+static void
+preview_reset(void)
+{
+	preview_len				  = 0;
+	preview_n				  = 0;
+	preview_version			  = winmap_version();
 	drag_state.preview_active = false;
 }
@@ -47,6 +47,17 @@
 #define IS_EXTERNAL(n)						   (n->node_type == EXTERNAL_NODE)
 #define IS_INTERNAL(n)						   (n->node_type == INTERNAL_NODE)
 #define IS_ROOT(n)							   (n->node_type == ROOT_NODE)
+#define RATIO_SHIFT							   16
+#define RATIO_ONE							   (1u << RATIO_SHIFT)
+#define RATIO_HALF							   (RATIO_ONE / 2)
+/* num/den as a ratio_t, rounded up so RATIO_APPLY(den, r) gives num back */
+#define RATIO_OF(num, den)                                                     \
+	((ratio_t)((((uint64_t)(num) << RATIO_SHIFT) + (den) - 1) / (den)))
+#define RATIO_APPLY(len, r)                                                    \
+	((int32_t)(((int64_t)(len) * (int64_t)(r)) >> RATIO_SHIFT))
+#define RECT_EQ(a, b)                                                          \
+	((a).x == (b).x && (a).y == (b).y && (a).width == (b).width &&             \
+	 (a).height == (b).height)
 
 #define DEFINE_KEY(mask, keysym, handler, arg) {mask, keysym, handler, arg}
 #define DEFINE_MAPPING(name, value)			   {name, value}
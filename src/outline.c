@@ -0,0 +1,289 @@
+/*
+ * BSD 2-Clause License
+ * Copyright (c) 2024, Yazeed Alharthi
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *	  1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ *
+ *	  2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "outline.h"
+#include "helper.h"
+#include "type.h"
+#include "zwm.h"
+#include <xcb/xcb.h>
+
+/* outline - the wireframe shown instead of live geometry while moving,
+ * resizing or dragging with outline_mode enabled, and the drop zone overlay
+ * of drag_overlay.
+ *
+ * four thin override-redirect bars make up a frame, so it shows the same
+ * with or without a compositor and never covers what is inside it. up to two
+ * frames are shown at once (both sides of a split). the bars are created on
+ * first use and only mapped, moved or unmapped after that */
+
+static xcb_window_t	  bars[8] = {XCB_NONE};
+static int			  shown	  = 0; /* frames on screen */
+static rectangle_t	  last[2] = {{0}};
+/* the drag drop zone, see drop_zone_show() */
+static xcb_window_t	  zone		 = XCB_NONE;
+static xcb_colormap_t zone_cmap	 = XCB_NONE;
+static bool			  zone_argb	 = true; /* until no argb visual is found */
+static bool			  zone_shown = false;
+static rectangle_t	  zone_last	 = {0};
+
+static void
+create_bars(void)
+{
+	const uint32_t mask	  = XCB_CW_BACK_PIXEL | XCB_CW_OVERRIDE_REDIRECT;
+	const uint32_t vals[] = {conf.active_border_color, 1};
+	for (int i = 0; i < 8; i++) {
+		bars[i] = xcb_generate_id(wm->connection);
+		xcb_create_window(wm->connection,
+						  XCB_COPY_FROM_PARENT,
+						  bars[i],
+						  wm->root_window,
+						  0,
+						  0,
+						  1,
+						  1,
+						  0,
+						  XCB_WINDOW_CLASS_INPUT_OUTPUT,
+						  XCB_COPY_FROM_PARENT,
+						  mask,
+						  vals);
+	}
+}
+
+static bool
+rect_same(rectangle_t a, rectangle_t b)
+{
+	return a.x == b.x && a.y == b.y && a.width == b.width &&
+		   a.height == b.height;
+}
+
+/* moves the four bars at b around r, mapping them on top if needed */
+static void
+place_frame(const xcb_window_t *b, rectangle_t r, bool map)
+{
+	const int32_t  t = conf.border_width > 0 ? conf.border_width : 2;
+	const int32_t  w = r.width + 2 * t;
+	const int32_t  h = r.height + 2 * t;
+	/* x, y, width, height of the top, bottom, left and right bars */
+	const int32_t  g[4][4] = {
+		 {r.x, r.y, w, t},
+		 {r.x, r.y + h - t, w, t},
+		 {r.x, r.y, t, h},
+		 {r.x + w - t, r.y, t, h},
+	};
+	const uint16_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+						  XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
+						  XCB_CONFIG_WINDOW_STACK_MODE;
+	for (int i = 0; i < 4; i++) {
+		const uint32_t v[] = {(uint32_t)g[i][0],
+							  (uint32_t)g[i][1],
+							  (uint32_t)(g[i][2] > 0 ? g[i][2] : 1),
+							  (uint32_t)(g[i][3] > 0 ? g[i][3] : 1),
+							  XCB_STACK_MODE_ABOVE};
+		xcb_cookie_t c = xcb_configure_window(wm->connection, b[i], mask, v);
+		track_request(c, b[i], XREQ_CONFIGURE);
+		if (map) {
+			c = xcb_map_window(wm->connection, b[i]);
+			track_request(c, b[i], XREQ_MAP);
+		}
+	}
+}
+
+/* shows one frame around each of the n rectangles, n <= 2 */
+static void
+show_frames(const rectangle_t *r, int n)
+{
+	if (n > 0 && bars[0] == XCB_NONE)
+		create_bars();
+
+	bool same = (n == shown);
+	for (int i = 0; same && i < n; i++)
+		same = rect_same(r[i], last[i]);
+	if (same)
+		return;
+
+	for (int i = 0; i < n; i++) {
+		place_frame(&bars[4 * i], r[i], i >= shown);
+		last[i] = r[i];
+	}
+	for (int i = 4 * n; i < 4 * shown; i++) {
+		xcb_cookie_t c = xcb_unmap_window(wm->connection, bars[i]);
+		track_request(c, bars[i], XREQ_UNMAP);
+	}
+	shown = n;
+}
+
+/* outline_show - moves the frame to r, mapping it on top if needed */
+void
+outline_show(rectangle_t r)
+{
+	show_frames(&r, 1);
+}
+
+/* outline_show_split - frames both sides of a split at once */
+void
+outline_show_split(rectangle_t a, rectangle_t b)
+{
+	const rectangle_t r[2] = {a, b};
+	show_frames(r, 2);
+}
+
+/* outline_hide - takes the frames off screen, the bars are kept for reuse */
+void
+outline_hide(void)
+{
+	show_frames(NULL, 0);
+}
+
+/* a 32 bit TrueColor visual, so the drop zone can be translucent under a
+ * compositor */
+static xcb_visualid_t
+argb_visual(void)
+{
+	xcb_depth_iterator_t d = xcb_screen_allowed_depths_iterator(wm->screen);
+	for (; d.rem; xcb_depth_next(&d)) {
+		if (d.data->depth != 32)
+			continue;
+		xcb_visualtype_iterator_t v = xcb_depth_visuals_iterator(d.data);
+		for (; v.rem; xcb_visualtype_next(&v)) {
+			if (v.data->_class == XCB_VISUAL_CLASS_TRUE_COLOR)
+				return v.data->visual_id;
+		}
+	}
+	return XCB_NONE;
+}
+
+/* the drop zone is a single window tinted with the active border color.
+ * without an argb visual it falls back to the outline bars */
+static void
+create_zone(void)
+{
+	const xcb_visualid_t v = argb_visual();
+	if (v == XCB_NONE) {
+		zone_argb = false;
+		return;
+	}
+
+	const uint32_t c = conf.active_border_color & 0xffffff;
+	/* 25% alpha, premultiplied as the compositor expects */
+	const uint32_t tint = 0x40000000u |
+						  (((c >> 16 & 0xff) * 0x40 / 0xff) << 16) |
+						  (((c >> 8 & 0xff) * 0x40 / 0xff) << 8) |
+						  ((c & 0xff) * 0x40 / 0xff);
+	zone_cmap			= xcb_generate_id(wm->connection);
+	xcb_create_colormap(
+		wm->connection, XCB_COLORMAP_ALLOC_NONE, zone_cmap, wm->root_window, v);
+
+	const uint32_t mask = XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL |
+						  XCB_CW_OVERRIDE_REDIRECT | XCB_CW_COLORMAP;
+	const uint32_t vals[] = {tint, 0xff000000u | c, 1, zone_cmap};
+	zone				  = xcb_generate_id(wm->connection);
+	xcb_create_window(wm->connection,
+					  32,
+					  zone,
+					  wm->root_window,
+					  0,
+					  0,
+					  1,
+					  1,
+					  0,
+					  XCB_WINDOW_CLASS_INPUT_OUTPUT,
+					  v,
+					  mask,
+					  vals);
+	zone_argb = true;
+}
+
+/* drop_zone_show - shows where a dragged window would land. r is a client
+ * rectangle, the zone's border sits where the client's would */
+void
+drop_zone_show(rectangle_t r)
+{
+	if (zone == XCB_NONE && zone_argb)
+		create_zone();
+	if (!zone_argb) {
+		outline_show(r);
+		return;
+	}
+	if (zone_shown && r.x == zone_last.x && r.y == zone_last.y &&
+		r.width == zone_last.width && r.height == zone_last.height)
+		return;
+
+	const uint16_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+						  XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
+						  XCB_CONFIG_WINDOW_BORDER_WIDTH |
+						  XCB_CONFIG_WINDOW_STACK_MODE;
+	const uint32_t v[]	= {(uint32_t)r.x,
+						   (uint32_t)r.y,
+						   r.width ? r.width : 1,
+						   r.height ? r.height : 1,
+						   conf.border_width > 0 ? conf.border_width : 2,
+						   XCB_STACK_MODE_ABOVE};
+	xcb_cookie_t c		= xcb_configure_window(wm->connection, zone, mask, v);
+	track_request(c, zone, XREQ_CONFIGURE);
+	if (!zone_shown) {
+		c = xcb_map_window(wm->connection, zone);
+		track_request(c, zone, XREQ_MAP);
+	}
+	zone_shown = true;
+	zone_last  = r;
+}
+
+void
+drop_zone_hide(void)
+{
+	if (!zone_argb) {
+		outline_hide();
+		return;
+	}
+	if (!zone_shown)
+		return;
+	xcb_cookie_t c = xcb_unmap_window(wm->connection, zone);
+	track_request(c, zone, XREQ_UNMAP);
+	zone_shown = false;
+}
+
+/* outline_free - destroys the frame and the drop zone, e.g. after the border
+ * color changed */
+void
+outline_free(void)
+{
+	if (zone != XCB_NONE) {
+		xcb_destroy_window(wm->connection, zone);
+		xcb_free_colormap(wm->connection, zone_cmap);
+		zone	   = XCB_NONE;
+		zone_shown = false;
+	}
+	zone_argb = true; /* look for the visual again on next use */
+	if (bars[0] == XCB_NONE)
+		return;
+	for (int i = 0; i < 8; i++) {
+		xcb_destroy_window(wm->connection, bars[i]);
+		bars[i] = XCB_NONE;
+	}
+	shown = 0;
+}
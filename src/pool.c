@@ -0,0 +1,215 @@
+/*
+ * BSD 2-Clause License
+ * Copyright (c) 2024, Yazeed Alharthi
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *	  1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ *
+ *	  2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pool.h"
+#include "helper.h"
+#include "type.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* pool - slab allocator for node_t and client_t.
+ *
+ * windows come and go all the time (terminals, dialogs, notifications), so
+ * instead of a malloc/free per node and client both are carved from slabs of
+ * POOL_SLAB_OBJS objects and recycled through a free list. nodes of a tree
+ * end up close to each other and, once the slabs are warm, managing and
+ * unmanaging windows never reaches the heap. pool_trim() gives fully unused
+ * slabs back, it is called after whole desktops are torn down */
+
+#define OBJ_ALIGN	  (sizeof(max_align_t))
+#define ALIGN_UP(n)	  (((n) + OBJ_ALIGN - 1) & ~(OBJ_ALIGN - 1))
+#define SLAB_HDR_SIZE (ALIGN_UP(sizeof(pool_slab_t)))
+
+static pool_t node_pool	  = {.obj_size = ALIGN_UP(sizeof(node_t))};
+static pool_t client_pool = {.obj_size = ALIGN_UP(sizeof(client_t))};
+
+static bool
+pool_grow(pool_t *p)
+{
+	pool_slab_t *s = malloc(SLAB_HDR_SIZE + p->obj_size * POOL_SLAB_OBJS);
+	if (s == NULL)
+		return false;
+	p->heap_allocs++;
+	p->n_slabs++;
+	s->objs	 = (char *)s + SLAB_HDR_SIZE;
+	s->next	 = p->slabs;
+	p->slabs = s;
+	/* pushed backwards so objects are handed out in address order */
+	for (size_t i = POOL_SLAB_OBJS; i--;) {
+		void *o		 = s->objs + i * p->obj_size;
+		*(void **)o	 = p->free_list;
+		p->free_list = o;
+	}
+	return true;
+}
+
+static void *
+pool_get(pool_t *p)
+{
+	if (p->free_list == NULL && !pool_grow(p))
+		return NULL;
+	void *o		 = p->free_list;
+	p->free_list = *(void **)o;
+	p->live++;
+	memset(o, 0, p->obj_size);
+	return o;
+}
+
+static void
+pool_put(pool_t *p, void *o)
+{
+	if (o == NULL)
+		return;
+	*(void **)o	 = p->free_list;
+	p->free_list = o;
+	p->live--;
+}
+
+/* index of the slab holding o, slabs counted from the head of the list */
+static size_t
+slab_of(const pool_t *p, const void *o)
+{
+	size_t i = 0;
+	for (pool_slab_t *s = p->slabs; s; s = s->next, i++) {
+		const char *c = o;
+		if (c >= s->objs && c < s->objs + p->obj_size * POOL_SLAB_OBJS)
+			break;
+	}
+	return i;
+}
+
+/* frees the slabs none of whose objects are in use */
+static void
+pool_release(pool_t *p)
+{
+	if (p->live == 0) {
+		/* the common case after a bulk release, no need to count */
+		while (p->slabs) {
+			pool_slab_t *next = p->slabs->next;
+			free(p->slabs);
+			p->slabs = next;
+		}
+		p->free_list = NULL;
+		p->n_slabs	 = 0;
+		return;
+	}
+
+	size_t		  n		  = p->n_slabs;
+	pool_slab_t **by_slab = calloc(n, sizeof(pool_slab_t *));
+	size_t		 *n_free  = calloc(n + 1, sizeof(size_t));
+	if (by_slab == NULL || n_free == NULL) {
+		_FREE_(by_slab);
+		_FREE_(n_free);
+		return;
+	}
+	size_t i = 0;
+	for (pool_slab_t *s = p->slabs; s; s = s->next) {
+		by_slab[i++] = s;
+	}
+	for (void *o = p->free_list; o; o = *(void **)o) {
+		n_free[slab_of(p, o)]++;
+	}
+
+	/* drop the free objects of empty slabs from the list, then the slabs */
+	void **link = &p->free_list;
+	while (*link) {
+		if (n_free[slab_of(p, *link)] == POOL_SLAB_OBJS)
+			*link = *(void **)*link;
+		else
+			link = (void **)*link;
+	}
+	pool_slab_t **sp = &p->slabs;
+	for (i = 0; i < n; i++) {
+		if (n_free[i] == POOL_SLAB_OBJS) {
+			*sp = by_slab[i]->next;
+			free(by_slab[i]);
+			p->n_slabs--;
+		} else {
+			sp = &by_slab[i]->next;
+		}
+	}
+	_FREE_(by_slab);
+	_FREE_(n_free);
+}
+
+node_t *
+pool_node_alloc(void)
+{
+	return pool_get(&node_pool);
+}
+
+void
+pool_node_free(node_t *n)
+{
+	pool_put(&node_pool, n);
+}
+
+client_t *
+pool_client_alloc(void)
+{
+	return pool_get(&client_pool);
+}
+
+void
+pool_client_free(client_t *c)
+{
+	pool_put(&client_pool, c);
+}
+
+void
+pool_trim(void)
+{
+	pool_release(&node_pool);
+	pool_release(&client_pool);
+}
+
+pool_stats_t
+pool_stats(void)
+{
+	return (pool_stats_t){
+		.live_nodes	  = node_pool.live,
+		.live_clients = client_pool.live,
+		.slabs		  = node_pool.n_slabs + client_pool.n_slabs,
+		.heap_allocs  = node_pool.heap_allocs + client_pool.heap_allocs,
+	};
+}
+
+void
+pool_log_stats(const char *when)
+{
+	const pool_stats_t s = pool_stats();
+	_LOG_(INFO,
+		  "pool (%s): %zu nodes, %zu clients live, %zu slabs, %zu slab "
+		  "allocs",
+		  when,
+		  s.live_nodes,
+		  s.live_clients,
+		  s.slabs,
+		  s.heap_allocs);
+}
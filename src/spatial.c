@@ -0,0 +1,594 @@
+/*
+ * BSD 2-Clause License
+ * Copyright (c) 2024, Yazeed Alharthi
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *	  1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ *
+ *	  2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "spatial.h"
+#include "helper.h"
+#include "type.h"
+#include "winmap.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* spatial - flattened leaf index of a desktop tree.
+ *
+ * drag hit testing runs on every motion event and directional focus used to
+ * walk the whole tree each time. the index keeps the client leaves of a
+ * desktop in tree order, their rectangles as packed x/y/w/h arrays, four
+ * permutations of them sorted by left/right/top/bottom edge and a grid over
+ * the distinct edges of the tiled leaves. a point lookup is two binary
+ * searches into the grid, a directional query is a binary search into the
+ * permutation of the facing edge, and the linear hit tests (no grid, and the
+ * resize edges and bands in zwm.c) scan packed arrays 4 or 8 rectangles at a
+ * time. the render diff in tree.c compares them in bulk.
+ *
+ * the index is rebuilt on the next query after the layout epoch moved (any
+ * arrange/render/resize or tree mutation calls spatial_invalidate()) or a
+ * window was managed or unmanaged. most renders leave every rectangle where
+ * it was, so the leaves are collected into a second set first and the sorted
+ * permutations and the grid are only redone when the two sets differ */
+
+enum { EDGE_LEFT, EDGE_RIGHT, EDGE_TOP, EDGE_BOTTOM };
+
+static uint32_t		  layout_epoch = 1;
+/* edge key of every leaf, only valid while sorting */
+static const int32_t *sort_keys	   = NULL;
+
+void
+spatial_invalidate(void)
+{
+	if (++layout_epoch == 0)
+		layout_epoch = 1;
+}
+
+static int32_t
+edge_of(const rect_soa_t *r, size_t i, int e)
+{
+	switch (e) {
+	case EDGE_LEFT: return r->x[i];
+	case EDGE_RIGHT: return r->x[i] + r->w[i];
+	case EDGE_TOP: return r->y[i];
+	default: return r->y[i] + r->h[i];
+	}
+}
+
+/* rect_soa_hit - index of the first rectangle at or after from that contains
+ * (px, py) once grown by margin on every side, or s->n if there is none */
+size_t
+rect_soa_hit(const rect_soa_t *s,
+			 size_t			   from,
+			 int32_t		   px,
+			 int32_t		   py,
+			 int32_t		   margin)
+{
+	size_t i = from;
+#if defined(__AVX2__)
+	const __m256i vpx = _mm256_set1_epi32(px);
+	const __m256i vpy = _mm256_set1_epi32(py);
+	const __m256i vm  = _mm256_set1_epi32(margin);
+	for (; i + 8 <= s->n; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(s->x + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(s->y + i));
+		__m256i w = _mm256_loadu_si256((const __m256i *)(s->w + i));
+		__m256i h = _mm256_loadu_si256((const __m256i *)(s->h + i));
+		__m256i x0 = _mm256_sub_epi32(x, vm);
+		__m256i y0 = _mm256_sub_epi32(y, vm);
+		__m256i x1 = _mm256_add_epi32(_mm256_add_epi32(x, w), vm);
+		__m256i y1 = _mm256_add_epi32(_mm256_add_epi32(y, h), vm);
+		/* x0 <= px < x1 && y0 <= py < y1 */
+		__m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(x0, vpx),
+									  _mm256_cmpgt_epi32(y0, vpy));
+		__m256i in	= _mm256_and_si256(_mm256_cmpgt_epi32(x1, vpx),
+									   _mm256_cmpgt_epi32(y1, vpy));
+		int mask = _mm256_movemask_ps(
+			_mm256_castsi256_ps(_mm256_andnot_si256(out, in)));
+		if (mask)
+			return i + (size_t)__builtin_ctz((unsigned)mask);
+	}
+#elif defined(__SSE2__)
+	const __m128i vpx = _mm_set1_epi32(px);
+	const __m128i vpy = _mm_set1_epi32(py);
+	const __m128i vm  = _mm_set1_epi32(margin);
+	for (; i + 4 <= s->n; i += 4) {
+		__m128i x	= _mm_loadu_si128((const __m128i *)(s->x + i));
+		__m128i y	= _mm_loadu_si128((const __m128i *)(s->y + i));
+		__m128i w	= _mm_loadu_si128((const __m128i *)(s->w + i));
+		__m128i h	= _mm_loadu_si128((const __m128i *)(s->h + i));
+		__m128i x0	= _mm_sub_epi32(x, vm);
+		__m128i y0	= _mm_sub_epi32(y, vm);
+		__m128i x1	= _mm_add_epi32(_mm_add_epi32(x, w), vm);
+		__m128i y1	= _mm_add_epi32(_mm_add_epi32(y, h), vm);
+		/* x0 <= px < x1 && y0 <= py < y1 */
+		__m128i out = _mm_or_si128(_mm_cmpgt_epi32(x0, vpx),
+								   _mm_cmpgt_epi32(y0, vpy));
+		__m128i in	= _mm_and_si128(_mm_cmpgt_epi32(x1, vpx),
+									_mm_cmpgt_epi32(y1, vpy));
+		int mask =
+			_mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(out, in)));
+		if (mask)
+			return i + (size_t)__builtin_ctz((unsigned)mask);
+	}
+#endif
+	for (; i < s->n; i++) {
+		if (px >= s->x[i] - margin && px < s->x[i] + s->w[i] + margin &&
+			py >= s->y[i] - margin && py < s->y[i] + s->h[i] + margin)
+			return i;
+	}
+	return s->n;
+}
+
+/* rect_soa_hits - rect_soa_hit for small sets that want every hit: bit i is
+ * set when rectangle i (of the first 32) holds the point */
+uint32_t
+rect_soa_hits(const rect_soa_t *s, int32_t px, int32_t py, int32_t margin)
+{
+	uint32_t	 mask = 0;
+	const size_t n	  = s->n < 32 ? s->n : 32;
+	for (size_t i = rect_soa_hit(s, 0, px, py, margin); i < n;
+		 i		  = rect_soa_hit(s, i + 1, px, py, margin))
+		mask |= 1u << i;
+	return mask;
+}
+
+/* rect_soa_equal - true if both hold the same rectangles in the same order */
+bool
+rect_soa_equal(const rect_soa_t *a, const rect_soa_t *b)
+{
+	if (a->n != b->n)
+		return false;
+	if (a->n == 0)
+		return true;
+
+	const size_t sz = a->n * sizeof(int32_t);
+	return memcmp(a->x, b->x, sz) == 0 && memcmp(a->y, b->y, sz) == 0 &&
+		   memcmp(a->w, b->w, sz) == 0 && memcmp(a->h, b->h, sz) == 0;
+}
+
+static bool
+leaf_set_equal(const leaf_set_t *a, const leaf_set_t *b)
+{
+	if (!rect_soa_equal(&a->rects, &b->rects))
+		return false;
+	if (a->rects.n == 0)
+		return true;
+
+	const size_t n = a->rects.n;
+	return memcmp(a->nodes, b->nodes, n * sizeof(*a->nodes)) == 0 &&
+		   memcmp(a->tiled, b->tiled, n * sizeof(*a->tiled)) == 0;
+}
+
+/* rect_soa_grow - makes room for cap rectangles, s->cap only moves once all
+ * four arrays got it */
+bool
+rect_soa_grow(rect_soa_t *s, size_t cap)
+{
+	if (cap <= s->cap)
+		return true;
+
+	int32_t **cols[4] = {&s->x, &s->y, &s->w, &s->h};
+	for (int c = 0; c < 4; c++) {
+		int32_t *p = realloc(*cols[c], cap * sizeof(*p));
+		if (p == NULL)
+			return false;
+		*cols[c] = p;
+	}
+	s->cap = cap;
+	return true;
+}
+
+void
+rect_soa_free(rect_soa_t *s)
+{
+	_FREE_(s->x);
+	_FREE_(s->y);
+	_FREE_(s->w);
+	_FREE_(s->h);
+	s->n = s->cap = 0;
+}
+
+static bool
+reserve_leaf_set(leaf_set_t *s, size_t n)
+{
+	rect_soa_t *r = &s->rects;
+	if (n <= r->cap)
+		return true;
+
+	size_t nc = r->cap ? r->cap : 16;
+	while (nc < n)
+		nc *= 2;
+
+	node_t **nodes = realloc(s->nodes, nc * sizeof(*nodes));
+	if (nodes == NULL)
+		return false;
+	s->nodes	   = nodes;
+	uint8_t *tiled = realloc(s->tiled, nc * sizeof(*tiled));
+	if (tiled == NULL)
+		return false;
+	s->tiled = tiled;
+	return rect_soa_grow(r, nc);
+}
+
+static bool
+reserve_edges(leaf_index_t *ix, size_t n)
+{
+	if (n <= ix->edge_cap)
+		return true;
+
+	size_t nc = ix->edge_cap ? ix->edge_cap : 16;
+	while (nc < n)
+		nc *= 2;
+
+	for (int e = 0; e < 4; e++) {
+		uint16_t *p = realloc(ix->by_edge[e], nc * sizeof(*p));
+		if (p == NULL)
+			return false;
+		ix->by_edge[e] = p;
+	}
+	/* two edges per leaf on each axis */
+	int32_t *xs = realloc(ix->xs, 2 * nc * sizeof(*xs));
+	if (xs == NULL)
+		return false;
+	ix->xs		= xs;
+	int32_t *ys = realloc(ix->ys, 2 * nc * sizeof(*ys));
+	if (ys == NULL)
+		return false;
+	ix->ys		 = ys;
+	ix->edge_cap = nc;
+	return true;
+}
+
+static bool
+collect_leaves(leaf_set_t *s, node_t *n)
+{
+	if (n == NULL)
+		return true;
+
+	if (IS_EXTERNAL(n)) {
+		if (n->client == NULL)
+			return true;
+		rect_soa_t *r = &s->rects;
+		/* ids are uint16_t */
+		if (r->n == UINT16_MAX || !reserve_leaf_set(s, r->n + 1))
+			return false;
+		s->nodes[r->n] = n;
+		s->tiled[r->n] = !IS_FLOATING(n->client);
+		r->x[r->n]	   = n->rectangle.x;
+		r->y[r->n]	   = n->rectangle.y;
+		r->w[r->n]	   = n->rectangle.width;
+		r->h[r->n]	   = n->rectangle.height;
+		r->n++;
+		return true;
+	}
+
+	return collect_leaves(s, n->first_child) &&
+		   collect_leaves(s, n->second_child);
+}
+
+static int
+cmp_edge_id(const void *pa, const void *pb)
+{
+	const uint16_t a = *(const uint16_t *)pa;
+	const uint16_t b = *(const uint16_t *)pb;
+	if (sort_keys[a] != sort_keys[b])
+		return sort_keys[a] < sort_keys[b] ? -1 : 1;
+	return (a > b) - (a < b);
+}
+
+static int
+cmp_i32(const void *pa, const void *pb)
+{
+	const int32_t a = *(const int32_t *)pa;
+	const int32_t b = *(const int32_t *)pb;
+	return (a > b) - (a < b);
+}
+
+/* sorts and dedups v in place, returns the new length */
+static size_t
+sort_unique(int32_t *v, size_t n)
+{
+	if (n == 0)
+		return 0;
+	qsort(v, n, sizeof(*v), cmp_i32);
+	size_t k = 1;
+	for (size_t i = 1; i < n; i++) {
+		if (v[i] != v[k - 1])
+			v[k++] = v[i];
+	}
+	return k;
+}
+
+/* first index in v[0..n) whose value is >= key */
+static size_t
+lower_bound(const int32_t *v, size_t n, int32_t key)
+{
+	size_t lo = 0, hi = n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (v[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* same as lower_bound, over leaf ids ordered by edge e */
+static size_t
+lower_bound_edge(const leaf_index_t *ix, int e, int32_t key)
+{
+	const uint16_t *p  = ix->by_edge[e];
+	size_t			lo = 0, hi = ix->cur.rects.n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (edge_of(&ix->cur.rects, p[mid], e) < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* builds the point grid. cells between consecutive distinct edges get the
+ * first tiled leaf (in tree order) covering them, which is the leaf the old
+ * recursive walk would have returned. when the grid would be too large the
+ * point lookup falls back to scanning the packed rectangles */
+static void
+build_grid(leaf_index_t *ix)
+{
+	const leaf_set_t *s = &ix->cur;
+	const rect_soa_t *r = &s->rects;
+	size_t			  nx = 0, ny = 0;
+	for (size_t i = 0; i < r->n; i++) {
+		if (!s->tiled[i])
+			continue;
+		ix->xs[nx++] = edge_of(r, i, EDGE_LEFT);
+		ix->xs[nx++] = edge_of(r, i, EDGE_RIGHT);
+		ix->ys[ny++] = edge_of(r, i, EDGE_TOP);
+		ix->ys[ny++] = edge_of(r, i, EDGE_BOTTOM);
+	}
+	ix->nx = sort_unique(ix->xs, nx);
+	ix->ny = sort_unique(ix->ys, ny);
+
+	size_t cells = (ix->nx > 1 && ix->ny > 1)
+					   ? (ix->nx - 1) * (ix->ny - 1)
+					   : 0;
+	if (cells == 0 || cells > SPATIAL_MAX_CELLS)
+		goto no_grid;
+
+	if (cells > ix->cell_cap) {
+		uint16_t *c = realloc(ix->cells, cells * sizeof(*c));
+		if (c == NULL)
+			goto no_grid;
+		ix->cells	 = c;
+		ix->cell_cap = cells;
+	}
+	memset(ix->cells, 0, cells * sizeof(*ix->cells));
+
+	const size_t stride = ix->nx - 1;
+	for (size_t i = 0; i < r->n; i++) {
+		if (!s->tiled[i])
+			continue;
+		size_t x0 = lower_bound(ix->xs, ix->nx, edge_of(r, i, EDGE_LEFT));
+		size_t x1 = lower_bound(ix->xs, ix->nx, edge_of(r, i, EDGE_RIGHT));
+		size_t y0 = lower_bound(ix->ys, ix->ny, edge_of(r, i, EDGE_TOP));
+		size_t y1 = lower_bound(ix->ys, ix->ny, edge_of(r, i, EDGE_BOTTOM));
+		for (size_t y = y0; y < y1; y++) {
+			uint16_t *row = &ix->cells[y * stride];
+			for (size_t x = x0; x < x1; x++) {
+				if (row[x] == 0)
+					row[x] = (uint16_t)(i + 1);
+			}
+		}
+	}
+	return;
+
+no_grid:
+	ix->nx = ix->ny = 0;
+}
+
+static leaf_index_t *
+spatial_get(desktop_t *d)
+{
+	if (d == NULL || d->tree == NULL)
+		return NULL;
+
+	if (d->index == NULL) {
+		d->index = calloc(1, sizeof(leaf_index_t));
+		if (d->index == NULL)
+			return NULL;
+	}
+
+	leaf_index_t *ix = d->index;
+	if (ix->epoch == layout_epoch && ix->version == winmap_version())
+		return ix;
+
+	ix->next.rects.n = 0;
+	if (!collect_leaves(&ix->next, d->tree)) {
+		_LOG_(ERROR, "failed to build the leaf index");
+		return NULL;
+	}
+
+	if (!leaf_set_equal(&ix->cur, &ix->next)) {
+		const size_t n = ix->next.rects.n;
+		if (!reserve_edges(ix, n)) {
+			_LOG_(ERROR, "failed to build the leaf index");
+			return NULL;
+		}
+
+		leaf_set_t t = ix->cur;
+		ix->cur		 = ix->next;
+		ix->next	 = t;
+
+		for (int e = 0; e < 4; e++) {
+			for (size_t i = 0; i < n; i++) {
+				ix->by_edge[e][i] = (uint16_t)i;
+				ix->xs[i]		  = edge_of(&ix->cur.rects, i, e);
+			}
+			sort_keys = ix->xs;
+			qsort(ix->by_edge[e], n, sizeof(uint16_t), cmp_edge_id);
+			sort_keys = NULL;
+		}
+		build_grid(ix);
+	}
+
+	ix->epoch	= layout_epoch;
+	ix->version = winmap_version();
+	return ix;
+}
+
+/* first tiled leaf at or after *from whose rectangle grown by margin holds
+ * the point, *from is moved past it */
+static node_t *
+scan_tiled(const leaf_set_t *s, size_t *from, int32_t x, int32_t y, int32_t m)
+{
+	const rect_soa_t *r = &s->rects;
+	for (size_t i = rect_soa_hit(r, *from, x, y, m); i < r->n;
+		 i		  = rect_soa_hit(r, i + 1, x, y, m)) {
+		if (s->tiled[i]) {
+			*from = i + 1;
+			return s->nodes[i];
+		}
+	}
+	*from = r->n;
+	return NULL;
+}
+
+node_t *
+spatial_leaf_at(desktop_t *d, int16_t x, int16_t y)
+{
+	leaf_index_t *ix = spatial_get(d);
+	if (ix == NULL || ix->cur.rects.n == 0)
+		return NULL;
+
+	if (ix->nx == 0) {
+		size_t from = 0;
+		return scan_tiled(&ix->cur, &from, x, y, 0);
+	}
+
+	/* cell i spans [xs[i], xs[i + 1]) */
+	size_t cx = lower_bound(ix->xs, ix->nx, (int32_t)x + 1);
+	size_t cy = lower_bound(ix->ys, ix->ny, (int32_t)y + 1);
+	if (cx == 0 || cx == ix->nx || cy == 0 || cy == ix->ny)
+		return NULL;
+
+	uint16_t id = ix->cells[(cy - 1) * (ix->nx - 1) + (cx - 1)];
+	return id ? ix->cur.nodes[id - 1] : NULL;
+}
+
+/* first leaf among p[from..to) that is not n and overlaps [lo, hi) on the
+ * axis across the direction of travel */
+static node_t *
+first_overlapping(const leaf_index_t *ix,
+				  const uint16_t	 *p,
+				  size_t			  from,
+				  size_t			  to,
+				  const node_t		 *n,
+				  bool				  horiz,
+				  int32_t			  lo,
+				  int32_t			  hi)
+{
+	const rect_soa_t *r = &ix->cur.rects;
+	for (size_t i = from; i < to; i++) {
+		int32_t c0 = horiz ? r->y[p[i]] : r->x[p[i]];
+		int32_t c1 = c0 + (horiz ? r->h[p[i]] : r->w[p[i]]);
+		if (ix->cur.nodes[p[i]] != n && lo < c1 && hi > c0)
+			return ix->cur.nodes[p[i]];
+	}
+	return NULL;
+}
+
+/* spatial_neighbor - the closest client leaf in direction dir from n, i.e.
+ * the one whose facing edge is nearest among those overlapping n on the other
+ * axis. ties go to the leaf that comes first in tree order */
+node_t *
+spatial_neighbor(desktop_t *d, node_t *n, direction_t dir)
+{
+	leaf_index_t *ix = spatial_get(d);
+	if (ix == NULL || n == NULL)
+		return NULL;
+
+	const rectangle_t *r	 = &n->rectangle;
+	const bool		   horiz = (dir == LEFT || dir == RIGHT);
+	const int32_t	   lo	 = horiz ? r->y : r->x;
+	const int32_t	   hi	 = lo + (horiz ? r->height : r->width);
+
+	if (dir == RIGHT || dir == DOWN) {
+		/* facing edges at or past ours, nearest first */
+		int		e	 = (dir == RIGHT) ? EDGE_LEFT : EDGE_TOP;
+		int32_t key	 = (dir == RIGHT) ? r->x + r->width : r->y + r->height;
+		size_t	from = lower_bound_edge(ix, e, key);
+		return first_overlapping(
+			ix, ix->by_edge[e], from, ix->cur.rects.n, n, horiz, lo, hi);
+	}
+	if (dir != LEFT && dir != UP)
+		return NULL;
+
+	/* facing edges at or before ours, nearest first. each run of equal edges
+	 * is scanned forwards so ties still go to the lowest id */
+	int				e	= (dir == LEFT) ? EDGE_RIGHT : EDGE_BOTTOM;
+	int32_t			key = (dir == LEFT) ? r->x : r->y;
+	const uint16_t *p	= ix->by_edge[e];
+	size_t			end = lower_bound_edge(ix, e, key + 1);
+	while (end > 0) {
+		int32_t run	  = edge_of(&ix->cur.rects, p[end - 1], e);
+		size_t	start = lower_bound_edge(ix, e, run);
+		node_t *c	  = first_overlapping(ix, p, start, end, n, horiz, lo, hi);
+		if (c)
+			return c;
+		end = start;
+	}
+	return NULL;
+}
+
+static void
+free_leaf_set(leaf_set_t *s)
+{
+	_FREE_(s->nodes);
+	_FREE_(s->tiled);
+	rect_soa_free(&s->rects);
+}
+
+void
+spatial_free(desktop_t *d)
+{
+	if (d == NULL || d->index == NULL)
+		return;
+
+	leaf_index_t *ix = d->index;
+	free_leaf_set(&ix->cur);
+	free_leaf_set(&ix->next);
+	for (int e = 0; e < 4; e++)
+		_FREE_(ix->by_edge[e]);
+	_FREE_(ix->xs);
+	_FREE_(ix->ys);
+	_FREE_(ix->cells);
+	_FREE_(d->index);
+}
@@ -0,0 +1,46 @@
+/*
+ * BSD 2-Clause License
+ * Copyright (c) 2024, Yazeed Alharthi
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *	  1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ *
+ *	  2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ZWM_SPATIAL_H
+#define ZWM_SPATIAL_H
+
+#include "type.h"
+
+/* clang-format off */
+void spatial_invalidate(void);
+size_t rect_soa_hit(const rect_soa_t *s, size_t from, int32_t px, int32_t py, int32_t margin);
+uint32_t rect_soa_hits(const rect_soa_t *s, int32_t px, int32_t py, int32_t margin);
+bool rect_soa_equal(const rect_soa_t *a, const rect_soa_t *b);
+bool rect_soa_grow(rect_soa_t *s, size_t cap);
+void rect_soa_free(rect_soa_t *s);
+node_t *spatial_leaf_at(desktop_t *d, int16_t x, int16_t y);
+node_t *spatial_neighbor(desktop_t *d, node_t *n, direction_t dir);
+void spatial_free(desktop_t *d);
+/* clang-format on */
+
+#endif /* ZWM_SPATIAL_H */
@@ -37,13 +37,17 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_icccm.h>
 
 #include "helper.h"
+#include "pool.h"
 #include "queue.h"
+#include "spatial.h"
 #include "type.h"
+#include "winmap.h"
 #include "zwm.h"
 
 /* clang-format off */
@@ -53,7 +57,8 @@ static void default_layout(node_t *parent);
 static node_t *find_tree_root(node_t *);
 static bool is_parent_null(const node_t *node);
 static rectangle_t _get_window_rectangle(node_t *node);
-static int _handle_fullscreen_window(xcb_window_t win);
+static rectangle_t _get_fullscreen_rectangle(node_t *node);
+static int _handle_fullscreen_window(node_t *node);
 static int _handle_window_nomap(node_t *node);
 /* clang-format on */
 
@@ -63,11 +68,10 @@ create_node(client_t *c)
 	if (c == 0x00)
 		return NULL;
 
-	node_t *node = (node_t *)malloc(sizeof(node_t));
-	if (node == 0x00) {
-		_FREE_(c);
+	/* on failure c stays with the caller, it may already be in a tree */
+	node_t *node = pool_node_alloc();
+	if (node == 0x00)
 		return NULL;
-	}
 
 	node->rectangle			 = (rectangle_t){0};
 	node->floating_rectangle = (rectangle_t){0};
@@ -78,7 +82,7 @@ create_node(client_t *c)
 	node->is_master			 = false;
 	node->is_focused		 = false;
 	node->split_type		 = DYNAMIC_TYPE;
-	node->split_ratio		 = 0.0;
+	node->split_ratio		 = 0;
 
 	return node;
 }
@@ -86,7 +90,7 @@ create_node(client_t *c)
 node_t *
 init_root(void)
 {
-	node_t *node = (node_t *)malloc(sizeof(node_t));
+	node_t *node = pool_node_alloc();
 	if (node == 0x00)
 		return NULL;
 
@@ -100,7 +104,7 @@ init_root(void)
 	node->is_master			 = false;
 	node->is_focused		 = false;
 	node->split_type		 = DYNAMIC_TYPE;
-	node->split_ratio		 = 0.0;
+	node->split_ratio		 = 0;
 
 	return node;
 }
@@ -110,6 +114,9 @@ init_root(void)
  * effects need to take place.
  * It is being used extensively in this code base.
  * Note: this function assumes rectangles and positions to be pre-calculated.
+ * Requests are only sent for windows whose geometry or map state differs from
+ * what was last committed (see commit_client_geometry), so re-rendering a
+ * tree after closing one window only touches its former siblings.
  */
 static int
 render_tree_internal(node_t *node, bool do_map)
@@ -129,7 +136,7 @@ render_tree_internal(node_t *node, bool do_map)
 		if (!IS_INTERNAL(current) && current->client) {
 			int result =
 				IS_FULLSCREEN(current->client)
-					? _handle_fullscreen_window(current->client->window)
+					? _handle_fullscreen_window(current)
 					: (do_map ? tile(current) : _handle_window_nomap(current));
 
 			if (result != 0) {
@@ -152,15 +159,137 @@ render_tree_internal(node_t *node, bool do_map)
 int
 render_tree(node_t *node)
 {
+	spatial_invalidate();
 	return render_tree_internal(node, true);
 }
 
 int
 render_tree_nomap(node_t *node)
 {
+	spatial_invalidate();
 	return render_tree_internal(node, false);
 }
 
+static bool
+reserve_drawn_set(drawn_set_t *s, size_t n)
+{
+	rect_soa_t *r = &s->rects;
+	if (n <= r->cap)
+		return true;
+
+	size_t nc = r->cap ? r->cap : 16;
+	while (nc < n)
+		nc *= 2;
+
+	node_t **nodes = realloc(s->nodes, nc * sizeof(*nodes));
+	if (nodes == NULL)
+		return false;
+	s->nodes		 = nodes;
+	uint16_t *border = realloc(s->border, nc * sizeof(*border));
+	if (border == NULL)
+		return false;
+	s->border = border;
+	return rect_soa_grow(r, nc);
+}
+
+/* appends what render_tree_internal would commit for every client leaf */
+static bool
+collect_drawn(drawn_set_t *s, node_t *n)
+{
+	if (n == NULL)
+		return true;
+
+	if (!IS_INTERNAL(n)) {
+		if (n->client == NULL)
+			return true;
+		rect_soa_t *r = &s->rects;
+		if (!reserve_drawn_set(s, r->n + 1))
+			return false;
+		const bool		  full = IS_FULLSCREEN(n->client);
+		const rectangle_t rc   = full ? _get_fullscreen_rectangle(n)
+									  : _get_window_rectangle(n);
+		s->nodes[r->n]		   = n;
+		s->border[r->n]		   = full ? 0 : (uint16_t)conf.border_width;
+		r->x[r->n]			   = rc.x;
+		r->y[r->n]			   = rc.y;
+		r->w[r->n]			   = rc.width;
+		r->h[r->n]			   = rc.height;
+		r->n++;
+		return true;
+	}
+
+	return collect_drawn(s, n->first_child) &&
+		   collect_drawn(s, n->second_child);
+}
+
+static bool
+drawn_set_equal(const drawn_set_t *a, const drawn_set_t *b)
+{
+	if (!rect_soa_equal(&a->rects, &b->rects))
+		return false;
+	if (a->rects.n == 0)
+		return true;
+
+	const size_t n = a->rects.n;
+	return memcmp(a->nodes, b->nodes, n * sizeof(*a->nodes)) == 0 &&
+		   memcmp(a->border, b->border, n * sizeof(*a->border)) == 0;
+}
+
+/* render_desktop - render_tree (do_map) or render_tree_nomap for d->tree.
+ * the rectangles the render would commit are collected into packed arrays
+ * first and compared in bulk with what the last render of d committed. if
+ * they match and no client's shadow changed since (shadow_version), every
+ * request would be skipped anyway and the tree is not walked at all */
+int
+render_desktop(desktop_t *d, bool do_map)
+{
+	if (d == NULL || d->tree == NULL)
+		return 0;
+
+	spatial_invalidate();
+	if (d->drawn == NULL) {
+		d->drawn = calloc(1, sizeof(render_set_t));
+		if (d->drawn == NULL)
+			return render_tree_internal(d->tree, do_map);
+	}
+
+	render_set_t *rs = d->drawn;
+	rs->next.rects.n = 0;
+	if (!collect_drawn(&rs->next, d->tree)) {
+		rs->valid = false;
+		return render_tree_internal(d->tree, do_map);
+	}
+
+	if (rs->valid && rs->version == shadow_version() &&
+		(rs->mapped || !do_map) && drawn_set_equal(&rs->cur, &rs->next))
+		return 0;
+
+	const int ret = render_tree_internal(d->tree, do_map);
+
+	drawn_set_t t = rs->cur;
+	rs->cur		  = rs->next;
+	rs->next	  = t;
+	rs->valid	  = (ret == 0);
+	rs->mapped	  = do_map;
+	rs->version	  = shadow_version();
+	return ret;
+}
+
+void
+render_set_free(desktop_t *d)
+{
+	if (d == NULL || d->drawn == NULL)
+		return;
+
+	drawn_set_t *sets[2] = {&d->drawn->cur, &d->drawn->next};
+	for (int i = 0; i < 2; i++) {
+		_FREE_(sets[i]->nodes);
+		_FREE_(sets[i]->border);
+		rect_soa_free(&sets[i]->rects);
+	}
+	_FREE_(d->drawn);
+}
+
 static rectangle_t
 _get_window_rectangle(node_t *node)
 {
@@ -170,14 +299,20 @@ _get_window_rectangle(node_t *node)
 	return node->rectangle;
 }
 
+static rectangle_t
+_get_fullscreen_rectangle(node_t *node)
+{
+	monitor_t *m = get_monitor_by_window(node->client->window);
+	return m ? m->rectangle : curr_monitor->rectangle;
+}
+
 static int
-_handle_fullscreen_window(xcb_window_t win)
+_handle_fullscreen_window(node_t *node)
 {
-	monitor_t  *m = get_monitor_by_window(win);
-	rectangle_t r = m ? m->rectangle : curr_monitor->rectangle;
+	xcb_window_t win = node->client->window;
+	rectangle_t	 r	 = _get_fullscreen_rectangle(node);
 
-	if (resize_window(win, r.width, r.height) != 0 ||
-		move_window(win, r.x, r.y) != 0) {
+	if (commit_client_geometry(node->client, r, 0) != 0) {
 		_LOG_(ERROR, "error resizing/moving fullscreen window %d", win);
 		return -1;
 	}
@@ -189,8 +324,7 @@ _handle_window_nomap(node_t *node)
 {
 	rectangle_t r = _get_window_rectangle(node);
 
-	if (resize_window(node->client->window, r.width, r.height) != 0 ||
-		move_window(node->client->window, r.x, r.y) != 0) {
+	if (commit_client_geometry(node->client, r, conf.border_width) != 0) {
 		_LOG_(ERROR, "error resizing/moving window %d", node->client->window);
 		return -1;
 	}
@@ -313,6 +447,7 @@ get_floating_child(const node_t *parent)
 static void
 insert_floating_node(node_t *node, desktop_t *d)
 {
+	spatial_invalidate();
 	assert(IS_FLOATING(node->client));
 	node_t *n = find_any_leaf(d->tree);
 	if (n == NULL)
@@ -326,11 +461,11 @@ insert_floating_node(node_t *node, desktop_t *d)
 	node->node_type = EXTERNAL_NODE;
 }
 
-static double
-normalize_split_ratio(double ratio)
+static ratio_t
+normalize_split_ratio(ratio_t ratio)
 {
-	if (ratio <= 0.0 || ratio >= 1.0)
-		return 0.5;
+	if (ratio == 0 || ratio >= RATIO_ONE)
+		return RATIO_HALF;
 	return ratio;
 }
 
@@ -341,29 +476,40 @@ update_split_ratio(node_t *parent, split_type_t s)
 		return;
 
 	const int16_t gap = conf.window_gap - conf.border_width;
-	double		  r	  = 0.5;
+	ratio_t		  r	  = RATIO_HALF;
 	if (s == HORIZONTAL_TYPE) {
 		int16_t avail = (int16_t)(parent->rectangle.width - gap);
 		if (avail > 0) {
-			r = (double)parent->first_child->rectangle.width / (double)avail;
+			r = RATIO_OF(parent->first_child->rectangle.width, avail);
 		}
 	} else if (s == VERTICAL_TYPE) {
 		int16_t avail = (int16_t)(parent->rectangle.height - gap);
 		if (avail > 0) {
-			r = (double)parent->first_child->rectangle.height / (double)avail;
+			r = RATIO_OF(parent->first_child->rectangle.height, avail);
 		}
 	}
 	parent->split_ratio = normalize_split_ratio(r);
 }
 
-static void
-split_rect(node_t *n, split_type_t s)
+static split_gaps_t
+split_gaps(void)
 {
-	const int16_t gap		  = conf.window_gap - conf.border_width;
-	const int16_t pgap		  = conf.window_gap + conf.border_width;
-	const double  ratio		  = normalize_split_ratio(n->split_ratio);
-	const int16_t half_width  = (int16_t)((n->rectangle.width - gap) * ratio);
-	const int16_t half_height = (int16_t)((n->rectangle.height - gap) * ratio);
+	return (split_gaps_t){
+		.shrink = conf.window_gap - conf.border_width,
+		.step	= conf.window_gap + conf.border_width,
+	};
+}
+
+static void
+split_rect(node_t *n, split_type_t s, const split_gaps_t *g)
+{
+	const int16_t gap		  = (int16_t)g->shrink;
+	const int16_t pgap		  = (int16_t)g->step;
+	const ratio_t ratio		  = normalize_split_ratio(n->split_ratio);
+	const int16_t half_width  = (int16_t)RATIO_APPLY(n->rectangle.width - gap,
+													 ratio);
+	const int16_t half_height = (int16_t)RATIO_APPLY(n->rectangle.height - gap,
+													 ratio);
 	node_t		 *n1		  = n->first_child;
 	node_t		 *n2		  = n->second_child;
 	rectangle_t	 *fr		  = &n1->rectangle;
@@ -402,7 +548,152 @@ split_node(node_t *n, node_t *nd)
 		s = (n->rectangle.width >= n->rectangle.height) ? HORIZONTAL_TYPE
 														: VERTICAL_TYPE;
 	}
-	split_rect(n, s);
+	const split_gaps_t g = split_gaps();
+	split_rect(n, s, &g);
+}
+
+/* layout engine.
+ *
+ * every layout is a top-down pass: once a node has its rectangle, the
+ * rectangles of its two children follow from it and nothing below. so
+ * instead of recursing per node, layout_walk() runs the pass with an
+ * explicit stack over one reused array. a node is placed when it is popped
+ * and its internal children are pushed. the gap math is done once per pass
+ * (split_gaps_t) and split ratios are fixed point, so a pass costs a few
+ * integer ops per node and gives the same pixels every time */
+typedef void (*place_fn_t)(node_t *, const split_gaps_t *);
+
+static node_t **layout_stack	 = NULL;
+static size_t	layout_stack_cap = 0;
+
+static void
+layout_walk(node_t *root, place_fn_t place)
+{
+	if (root == NULL)
+		return;
+
+	const split_gaps_t g   = split_gaps();
+	size_t			   top = 0;
+	node_t			  *n   = root;
+	for (;;) {
+		if (n->first_child && n->second_child) {
+			place(n, &g);
+			if (top + 2 > layout_stack_cap) {
+				size_t	 nc = layout_stack_cap ? layout_stack_cap * 2 : 64;
+				node_t **s	= realloc(layout_stack, nc * sizeof(*s));
+				if (s == NULL) {
+					_LOG_(ERROR, "failed to grow the layout stack");
+					return;
+				}
+				layout_stack	 = s;
+				layout_stack_cap = nc;
+			}
+			if (IS_INTERNAL(n->second_child))
+				layout_stack[top++] = n->second_child;
+			if (IS_INTERNAL(n->first_child))
+				layout_stack[top++] = n->first_child;
+		}
+		if (top == 0)
+			break;
+		n = layout_stack[--top];
+	}
+}
+
+void
+layout_free(void)
+{
+	_FREE_(layout_stack);
+	layout_stack_cap = 0;
+}
+
+/* gives the children of n their halves of r and r2, except that a floating
+ * child keeps its floating rectangle and its sibling takes all of n */
+static void
+place_children(node_t *n, rectangle_t r, rectangle_t r2)
+{
+	node_t	  *a	  = n->first_child;
+	node_t	  *b	  = n->second_child;
+	const bool a_float = a->client && IS_FLOATING(a->client);
+	const bool b_float = b->client && IS_FLOATING(b->client);
+
+	a->rectangle = b_float ? n->rectangle : a_float ? a->floating_rectangle : r;
+	b->rectangle = a_float ? n->rectangle : b_float ? b->floating_rectangle : r2;
+}
+
+/* halves of n along s, the first one being ratio of the room left after
+ * the gap */
+static void
+split_halves(const node_t		*n,
+			 split_type_t		 s,
+			 ratio_t			 ratio,
+			 const split_gaps_t *g,
+			 rectangle_t		*r,
+			 rectangle_t		*r2)
+{
+	const rectangle_t p = n->rectangle;
+	*r					= p;
+	*r2					= p;
+	if (s == HORIZONTAL_TYPE) {
+		/* vertical split (side by side) */
+		r->width   = (uint16_t)RATIO_APPLY(p.width - g->shrink, ratio);
+		r2->x	   = (int16_t)(p.x + r->width + g->step);
+		r2->width  = (uint16_t)(p.width - r->width - g->step);
+	} else {
+		/* horizontal split (top and bottom) */
+		r->height  = (uint16_t)RATIO_APPLY(p.height - g->shrink, ratio);
+		r2->y	   = (int16_t)(p.y + r->height + g->step);
+		r2->height = (uint16_t)(p.height - r->height - g->step);
+	}
+}
+
+static split_type_t
+resolve_split(const node_t *n)
+{
+	if (n->split_type != DYNAMIC_TYPE)
+		return n->split_type;
+	return (n->rectangle.width >= n->rectangle.height) ? HORIZONTAL_TYPE
+													   : VERTICAL_TYPE;
+}
+
+static void
+place_default(node_t *n, const split_gaps_t *g)
+{
+	rectangle_t r, r2;
+	split_halves(
+		n, resolve_split(n), normalize_split_ratio(n->split_ratio), g, &r, &r2);
+	place_children(n, r, r2);
+}
+
+/* the master keeps the rectangle master_layout gave it, everything else
+ * splits the stack area in halves top to bottom */
+static void
+place_master(node_t *n, const split_gaps_t *g)
+{
+	if (n->first_child->is_master) {
+		n->second_child->rectangle = n->rectangle;
+	} else if (n->second_child->is_master) {
+		n->first_child->rectangle = n->rectangle;
+	} else {
+		rectangle_t r, r2;
+		split_halves(n, VERTICAL_TYPE, RATIO_HALF, g, &r, &r2);
+		place_children(n, r, r2);
+	}
+}
+
+/* every window gets the whole area */
+static void
+place_stack(node_t *n, const split_gaps_t *g)
+{
+	(void)g;
+	n->first_child->rectangle  = n->rectangle;
+	n->second_child->rectangle = n->rectangle;
+}
+
+/* what insert_node does to a split, used when only a subtree is resized */
+static void
+place_split(node_t *n, const split_gaps_t *g)
+{
+	split_rect(n, resolve_split(n), g);
 }
 
 /* insert_node - change the given focused node type to be internal, and then
@@ -411,6 +702,7 @@ split_node(node_t *n, node_t *nd)
 void
 insert_node(node_t *node, node_t *new_node, layout_t layout)
 {
+	spatial_invalidate();
 #ifdef _DEBUG__
 	_LOG_(DEBUG,
 		  "node to split %d, node to insert %d",
@@ -454,6 +746,7 @@ insert_node(node_t *node, node_t *new_node, layout_t layout)
 	node->first_child->parent	 = node;
 	node->first_child->node_type = EXTERNAL_NODE;
 	node->client				 = NULL;
+	winmap_relink(node, node->first_child);
 
 	if (move_rect) {
 		node->first_child->floating_rectangle = node->floating_rectangle;
@@ -466,6 +759,14 @@ insert_node(node_t *node, node_t *new_node, layout_t layout)
 	node->second_child->parent	  = node;
 	node->second_child->node_type = EXTERNAL_NODE;
 
+	/* the new leaf lives wherever the node it split does. clones (drag
+	 * preview) never own the entry, so they leave the index alone */
+	winmap_entry_t *e = winmap_get(node->first_child->client->window);
+	if (e && e->node == node->first_child) {
+		winmap_put(
+			new_node->client->window, new_node, e->desktop, e->monitor);
+	}
+
 	if (layout == DEFAULT) {
 		split_node(node, new_node);
 	} else if (layout == STACK) {
@@ -492,7 +793,7 @@ clone_tree(node_t *r, node_t *p)
 	if (!r)
 		return NULL;
 
-	node_t *n = (node_t *)calloc(1, sizeof(node_t));
+	node_t *n = pool_node_alloc();
 	if (!n)
 		return NULL;
 
@@ -506,9 +807,9 @@ clone_tree(node_t *r, node_t *p)
 	n->floating_rectangle = r->floating_rectangle;
 
 	if (r->client) {
-		client_t *c = (client_t *)malloc(sizeof(client_t));
+		client_t *c = pool_client_alloc();
 		if (!c) {
-			_FREE_(n);
+			pool_node_free(n);
 			return NULL;
 		}
 		*c		  = *r->client;
@@ -537,6 +838,7 @@ clone_tree(node_t *r, node_t *p)
 void
 arrange_tree(node_t *tree, layout_t l)
 {
+	spatial_invalidate();
 	if (!tree) {
 		return;
 	}
@@ -588,8 +890,8 @@ free_tree(node_t *root)
 	}
 	free_tree(root->first_child);
 	free_tree(root->second_child);
-	_FREE_(root->client);
-	_FREE_(root);
+	pool_client_free(root->client);
+	pool_node_free(root);
 }
 
 /* resize_subtree - recursively resizes the subtree of a given parent node based
@@ -597,27 +899,8 @@ free_tree(node_t *root)
 void
 resize_subtree(node_t *parent)
 {
-	if (parent == NULL)
-		return;
-
-	split_type_t s = parent->split_type;
-	if (s == DYNAMIC_TYPE) {
-		s = (parent->rectangle.width >= parent->rectangle.height)
-				? HORIZONTAL_TYPE
-				: VERTICAL_TYPE;
-	}
-	split_rect(parent, s);
-
-	if (parent->first_child) {
-		if (IS_INTERNAL(parent->first_child)) {
-			resize_subtree(parent->first_child);
-		}
-	}
-	if (parent->second_child) {
-		if (IS_INTERNAL(parent->second_child)) {
-			resize_subtree(parent->second_child);
-		}
-	}
+	spatial_invalidate();
+	layout_walk(parent, place_split);
 }
 
 node_t *
@@ -753,10 +1036,12 @@ collect_clients(node_t *n, stack_item_t **out, size_t *cap, size_t *len)
 	if (n->client && n->client->window != XCB_NONE &&
 		!n->client->override_redirect) {
 		if (*len == *cap) {
-			*cap = (*cap ? *cap * 2 : 16);
-			*out = realloc(*out, *cap * sizeof(**out));
-			if (!*out)
+			size_t		  grown = (*cap ? *cap * 2 : 16);
+			stack_item_t *o		= realloc(*out, grown * sizeof(**out));
+			if (!o)
 				return;
+			*out = o;
+			*cap = grown;
 		}
 		(*out)[*len].c	 = n->client;
 		(*out)[*len].key = stack_key(n->client);
@@ -766,21 +1051,6 @@ collect_clients(node_t *n, stack_item_t **out, size_t *cap, size_t *len)
 	collect_clients(n->second_child, out, cap, len);
 }
 
-static void
-collect_clients_global(stack_item_t **out, size_t *cap, size_t *len)
-{
-	monitor_t *m = head_monitor;
-	while (m) {
-		for (int i = 0; i < m->n_of_desktops; i++) {
-			desktop_t *d = m->desktops[i];
-			if (!d || !d->tree)
-				continue;
-			collect_clients(d->tree, out, cap, len);
-		}
-		m = m->next;
-	}
-}
-
 static int
 cmp_stack_item(const void *pa, const void *pb)
 {
@@ -798,53 +1068,347 @@ cmp_stack_item(const void *pa, const void *pb)
 	return 0;
 }
 
-void
-restack(void)
+/* the position a window had in the committed order, found by binary search
+ * over a copy sorted by window id */
+typedef struct {
+	xcb_window_t window;
+	uint32_t	 index;
+} stack_pos_t;
+
+static int
+cmp_stack_pos(const void *pa, const void *pb)
+{
+	const stack_pos_t *a = pa, *b = pb;
+	return (a->window > b->window) - (a->window < b->window);
+}
+
+static bool
+reserve_stack(monitor_t *m, uint32_t n)
 {
-	stack_item_t *v	  = NULL;
-	size_t		  cap = 0, len = 0;
-	collect_clients_global(&v, &cap, &len);
-	if (!v || !len) {
-		xcb_ewmh_set_client_list_stacking(wm->ewmh, wm->screen_nbr, 0, NULL);
-		free(v);
+	if (n <= m->stack_cap) {
+		return true;
+	}
+	uint32_t	  cap = m->stack_cap ? m->stack_cap : 16;
+	while (cap < n) {
+		cap *= 2;
+	}
+	xcb_window_t *s = realloc(m->stack, cap * sizeof(*s));
+	if (s == NULL) {
+		_LOG_(ERROR, "cannot grow stacking order for monitor %s", m->name);
+		return false;
+	}
+	m->stack	 = s;
+	m->stack_cap = cap;
+	return true;
+}
+
+/* mark_stable - flags the longest run of windows that are already in the
+ * right relative order on the server (longest increasing subsequence of their
+ * committed positions). those are left alone, only the rest get restacked */
+static void
+mark_stable(
+	const int32_t *pos, size_t n, bool *keep, size_t *tails, size_t *prev)
+{
+	const size_t none = (size_t)-1;
+	size_t		 len  = 0;
+	for (size_t i = 0; i < n; i++) {
+		keep[i] = false;
+		prev[i] = none;
+		if (pos[i] < 0) {
+			continue;
+		}
+		size_t lo = 0, hi = len;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (pos[tails[mid]] < pos[i]) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		prev[i]	  = lo ? tails[lo - 1] : none;
+		tails[lo] = i;
+		if (lo == len) {
+			len++;
+		}
+	}
+	for (size_t k = len ? tails[len - 1] : none; k != none; k = prev[k]) {
+		keep[k] = true;
+	}
+}
+
+/* restack_monitor - brings the server in line with the wanted order in v
+ * using as few ConfigureWindow requests as possible, then records v as the
+ * committed order */
+static void
+restack_monitor(monitor_t *m, const stack_item_t *v, size_t len)
+{
+	if (len == 0) {
+		m->stack_len = 0;
 		return;
 	}
 
-	qsort(v, len, sizeof *v, cmp_stack_item);
+	uint8_t *scratch = malloc(len * (sizeof(int32_t) + sizeof(bool) +
+									 2 * sizeof(size_t)) +
+							  m->stack_len * sizeof(stack_pos_t));
+	if (scratch == NULL || !reserve_stack(m, (uint32_t)len)) {
+		_LOG_(ERROR, "cannot allocate restack scratch space");
+		free(scratch);
+		return;
+	}
+	size_t		*tails = (size_t *)scratch;
+	size_t		*prev  = tails + len;
+	stack_pos_t *old   = (stack_pos_t *)(prev + len);
+	int32_t		*pos   = (int32_t *)(old + m->stack_len);
+	bool		*keep  = (bool *)(pos + len);
+
+	for (uint32_t i = 0; i < m->stack_len; i++) {
+		old[i] = (stack_pos_t){.window = m->stack[i], .index = i};
+	}
+	qsort(old, m->stack_len, sizeof(*old), cmp_stack_pos);
+	for (size_t i = 0; i < len; i++) {
+		const stack_pos_t  key = {.window = v[i].c->window};
+		const stack_pos_t *hit =
+			bsearch(&key, old, m->stack_len, sizeof(*old), cmp_stack_pos);
+		pos[i] = hit ? (int32_t)hit->index : -1;
+	}
+
+	mark_stable(pos, len, keep, tails, prev);
+
+	/* walk bottom to top, so every window we move is placed right above a
+	 * predecessor that is already where it belongs */
+	for (size_t i = 0; i < len; i++) {
+		if (keep[i]) {
+			continue;
+		}
+		if (i == 0) {
+			lower_window(v[0].c->window);
+		} else {
+			window_above(v[i].c->window, v[i - 1].c->window);
+		}
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		m->stack[i] = v[i].c->window;
+	}
+	m->stack_len = (uint32_t)len;
+	free(scratch);
+}
+
+/* restack_note_raise - a window was raised outside of restack (focus, mouse
+ * or drag), move it to the top of its monitor's committed order */
+void
+restack_note_raise(xcb_window_t win)
+{
+	monitor_t *m = get_monitor_by_window(win);
+	if (m == NULL) {
+		return;
+	}
+	for (uint32_t i = 0; i < m->stack_len; i++) {
+		if (m->stack[i] == win) {
+			memmove(&m->stack[i],
+					&m->stack[i + 1],
+					(m->stack_len - i - 1) * sizeof(*m->stack));
+			m->stack[m->stack_len - 1] = win;
+			return;
+		}
+	}
+}
 
-	/* enforce global bottom-to-top order for all managed clients */
-	client_t *bottom = v[0].c;
-	if (bottom) {
-		lower_window(bottom->window);
+static bool
+reserve_windows(xcb_window_t **w, size_t *cap, size_t n)
+{
+	if (n <= *cap) {
+		return true;
+	}
+	size_t c = *cap ? *cap : 16;
+	while (c < n) {
+		c *= 2;
+	}
+	xcb_window_t *p = realloc(*w, c * sizeof(*p));
+	if (p == NULL) {
+		return false;
 	}
-	for (size_t i = 1; i < len; i++) {
-		client_t *c = v[i].c;
-		client_t *p = v[i - 1].c;
-		if (!c || !p)
+	*w	 = p;
+	*cap = c;
+	return true;
+}
+
+/* hidden_stale - true once the windows of the hidden desktops may differ from
+ * the last collect_hidden: a window was managed, unmanaged or sent to another
+ * desktop, or some monitor shows another desktop */
+static bool
+hidden_stale(void)
+{
+	static desktop_t **shown	 = NULL;
+	static size_t	   shown_len = 0;
+	static size_t	   shown_cap = 0;
+	static uint32_t	   version	 = 0;
+	static bool		   ever		 = false;
+
+	bool   stale = !ever || version != winmap_place_version();
+	size_t n	 = 0;
+	for (monitor_t *m = head_monitor; m; m = m->next, n++) {
+		if (n < shown_len && shown[n] == m->desk) {
 			continue;
-		window_above(c->window, p->window);
+		}
+		stale = true;
+		if (n == shown_cap) {
+			size_t		c = shown_cap ? shown_cap * 2 : 4;
+			desktop_t **p = realloc(shown, c * sizeof(*p));
+			if (p == NULL) {
+				ever = false; /* try again next time */
+				return true;
+			}
+			shown	  = p;
+			shown_cap = c;
+		}
+		shown[n] = m->desk;
+	}
+	stale	  = stale || n != shown_len;
+	shown_len = n;
+	version	  = winmap_place_version();
+	ever	  = true;
+	return stale;
+}
+
+/* collect_hidden - the managed windows of every desktop that is not shown,
+ * bottom to top in the order they were last published in. windows that were
+ * never published (managed while hidden) go on top of them by stack_key */
+static size_t
+collect_hidden(stack_item_t		  **out,
+			   size_t			   *cap,
+			   const xcb_window_t *published,
+			   size_t				published_len)
+{
+	size_t len = 0;
+	for (monitor_t *m = head_monitor; m; m = m->next) {
+		for (int j = 0; j < m->n_of_desktops; j++) {
+			desktop_t *d = m->desktops[j];
+			if (d && d != m->desk && d->tree) {
+				collect_clients(d->tree, out, cap, &len);
+			}
+		}
+	}
+	if (len == 0) {
+		return 0;
+	}
+
+	stack_pos_t *old = malloc(published_len * sizeof(*old) + 1);
+	if (old == NULL) {
+		qsort(*out, len, sizeof(**out), cmp_stack_item);
+		return len;
 	}
+	for (size_t i = 0; i < published_len; i++) {
+		old[i] = (stack_pos_t){.window = published[i], .index = (uint32_t)i};
+	}
+	qsort(old, published_len, sizeof(*old), cmp_stack_pos);
 
-	/* raise fullscreen windows above all*/
+	/* published ones first, keyed by their old position */
+	size_t seen = 0;
 	for (size_t i = 0; i < len; i++) {
-		client_t *c = v[i].c;
-		if (c && IS_FULLSCREEN(c)) {
-			raise_window(c->window);
+		const stack_pos_t  key = {.window = (*out)[i].c->window};
+		const stack_pos_t *hit =
+			bsearch(&key, old, published_len, sizeof(*old), cmp_stack_pos);
+		if (hit) {
+			stack_item_t t = (*out)[i];
+			t.key		   = hit->index;
+			(*out)[i]	   = (*out)[seen];
+			(*out)[seen++] = t;
+		}
+	}
+	qsort(*out, seen, sizeof(**out), cmp_stack_item);
+	qsort(*out + seen, len - seen, sizeof(**out), cmp_stack_item);
+	free(old);
+	return len;
+}
+
+/* restack - orders the visible windows of every monitor by stack_key.
+ * each monitor keeps the order it last committed to the server and only the
+ * windows that are out of place get a ConfigureWindow. hidden desktops are
+ * unmapped, so they are not restacked until they are shown again. their
+ * windows are still published, below the visible ones, from a list that is
+ * only rebuilt when hidden_stale() says so */
+void
+restack(void)
+{
+	/* kept across calls, restack runs on every focus change */
+	static stack_item_t *v			   = NULL;
+	static size_t		 cap		   = 0;
+	static stack_item_t *hv			   = NULL;
+	static size_t		 hcap		   = 0;
+	static size_t		 hidden		   = 0;
+	static bool			 hidden_placed = false;
+	static xcb_window_t *published	   = NULL;
+	static size_t		 published_len = 0;
+	static size_t		 published_cap = 0;
+	static bool			 ever		   = false;
+
+	size_t total   = 0;
+	bool   changed = !ever;
+
+	/* _NET_CLIENT_LIST_STACKING is bottom to top, the hidden windows go
+	 * first. when they did not change they are already in place */
+	if (hidden_stale()) {
+		hidden		  = collect_hidden(&hv, &hcap, published, published_len);
+		hidden_placed = false;
+	}
+	if (hidden_placed) {
+		total = hidden;
+	} else if (reserve_windows(&published, &published_cap, hidden)) {
+		for (size_t i = 0; i < hidden; i++, total++) {
+			if (total >= published_len ||
+				published[total] != hv[i].c->window) {
+				changed = true;
+			}
+			published[total] = hv[i].c->window;
 		}
+		hidden_placed = true;
+	} else {
+		_LOG_(ERROR, "cannot grow _NET_CLIENT_LIST_STACKING");
 	}
 
-	/* publish _NET_CLIENT_LIST_STACKING */
-	xcb_window_t *stack = calloc(len, sizeof(*stack));
-	if (stack) {
+	for (monitor_t *m = head_monitor; m; m = m->next) {
+		size_t len = 0;
+		if (m->desk && m->desk->tree) {
+			collect_clients(m->desk->tree, &v, &cap, &len);
+		}
+		if (len > 1) {
+			qsort(v, len, sizeof *v, cmp_stack_item);
+		}
+		restack_monitor(m, v, len);
+
+		/* raise fullscreen windows above all*/
 		for (size_t i = 0; i < len; i++) {
-			stack[i] = v[i].c ? v[i].c->window : XCB_NONE;
+			if (IS_FULLSCREEN(v[i].c)) {
+				raise_window(v[i].c->window);
+			}
+		}
+
+		if (!reserve_windows(&published, &published_cap, total + len)) {
+			_LOG_(ERROR, "cannot grow _NET_CLIENT_LIST_STACKING");
+			continue;
+		}
+		/* compare while copying, the old order is overwritten in place */
+		for (size_t i = 0; i < len; i++, total++) {
+			if (total >= published_len ||
+				published[total] != v[i].c->window) {
+				changed = true;
+			}
+			published[total] = v[i].c->window;
 		}
-		xcb_ewmh_set_client_list_stacking(wm->ewmh, wm->screen_nbr, len, stack);
-		free(stack);
 	}
-	xcb_flush(wm->connection);
 
-	free(v);
+	/* publish _NET_CLIENT_LIST_STACKING, but only if the order moved. pagers
+	 * and bars listen for PropertyNotify on root and would wake up for
+	 * every crossing otherwise */
+	if (changed || total != published_len) {
+		xcb_ewmh_set_client_list_stacking(
+			wm->ewmh, wm->screen_nbr, total, published);
+		published_len = total;
+		ever		  = true;
+	}
+	xcb_flush(wm->connection);
 }
 
 /* deprecated */
@@ -1136,86 +1700,12 @@ find_leaf_at_point(node_t *root, int16_t x, int16_t y)
 
 /* apply_default_layout - applies the default tiling layout to a given tree
  *
- * recursively applies the default tiling layout to a node and its
- * descendants in the tree. The default layout splits nodes based on
- * their stored split type (if set) or their dimensions. */
+ * lays out a node's descendants in the tree. The default layout splits
+ * nodes based on their stored split type (if set) or their dimensions. */
 void
 apply_default_layout(node_t *root)
 {
-	if (root == NULL)
-		return;
-
-	if (root->first_child == NULL && root->second_child == NULL) {
-		return;
-	}
-
-	rectangle_t	   r, r2 = {0};
-	const uint16_t mgap	 = (conf.window_gap - conf.border_width);
-	split_type_t   s	 = root->split_type;
-	const double   ratio = normalize_split_ratio(root->split_ratio);
-	if (s == DYNAMIC_TYPE) {
-		s = (root->rectangle.width >= root->rectangle.height) ? HORIZONTAL_TYPE
-															  : VERTICAL_TYPE;
-	}
-	/* determine split orientation based on node split type */
-	if (s == HORIZONTAL_TYPE) {
-		/* vertical split (side by side) */
-		r.x		 = root->rectangle.x;
-		r.y		 = root->rectangle.y;
-		r.width	 = (uint16_t)((root->rectangle.width - mgap) * ratio);
-		r.height = root->rectangle.height;
-		r2.x	 = (int16_t)(root->rectangle.x + r.width + conf.window_gap +
-						 conf.border_width);
-		r2.y	 = root->rectangle.y;
-		r2.width = root->rectangle.width - r.width - conf.window_gap -
-				   conf.border_width;
-		r2.height = root->rectangle.height;
-	} else {
-		/* horizontal split (top and bottom) */
-		r.x		  = root->rectangle.x;
-		r.y		  = root->rectangle.y;
-		r.width	  = root->rectangle.width;
-		r.height  = (uint16_t)((root->rectangle.height - mgap) * ratio);
-		r2.x	  = root->rectangle.x;
-		r2.y	  = (int16_t)(root->rectangle.y + r.height + conf.window_gap +
-						  conf.border_width);
-		r2.width  = root->rectangle.width;
-		r2.height = root->rectangle.height - r.height - conf.window_gap -
-					conf.border_width;
-	}
-
-	/* this nested unreadable ternary code basically forces floating windows
-	 * to retain their floating rectangle and give the full parent's
-	 * rectangle to the other child. In some rare cases, this does not work
-	 * as expected , I am still looking into it */
-	if (root->first_child) {
-		root->first_child->rectangle =
-			((root->second_child->client) &&
-			 IS_FLOATING(root->second_child->client))
-				? root->rectangle
-			: ((root->first_child->client) &&
-			   IS_FLOATING(root->first_child->client))
-				? root->first_child->floating_rectangle
-				: r;
-		if (IS_INTERNAL(root->first_child)) {
-			apply_default_layout(root->first_child);
-		}
-	}
-
-	/* same as above */
-	if (root->second_child) {
-		root->second_child->rectangle =
-			((root->first_child->client) &&
-			 IS_FLOATING(root->first_child->client))
-				? root->rectangle
-			: ((root->second_child->client) &&
-			   IS_FLOATING(root->second_child->client))
-				? root->second_child->floating_rectangle
-				: r2;
-		if (IS_INTERNAL(root->second_child)) {
-			apply_default_layout(root->second_child);
-		}
-	}
+	layout_walk(root, place_default);
 }
 
 static void
@@ -1251,77 +1741,26 @@ default_layout(node_t *root)
  *
  * implements a master-stack layout, where one window (the master)
  * takes up a larger portion of the screen (70%), and the rest are stacked.
- * TODO: use next_node() to implement this
  */
 void
 apply_master_layout(node_t *parent)
 {
-	if (parent == NULL)
-		return;
-
-	if (parent->first_child->is_master) {
-		parent->second_child->rectangle = parent->rectangle;
-	} else if (parent->second_child->is_master) {
-		parent->first_child->rectangle = parent->rectangle;
-	} else {
-		rectangle_t r, r2 = {0};
-		r.x		  = parent->rectangle.x;
-		r.y		  = parent->rectangle.y;
-		r.width	  = parent->rectangle.width;
-		r.height  = (uint16_t)((parent->rectangle.height -
-								(conf.window_gap - conf.border_width)) /
-							   2);
-
-		r2.x	  = parent->rectangle.x;
-		r2.y	  = (int16_t)(parent->rectangle.y + r.height + conf.window_gap +
-						  conf.border_width);
-		r2.width  = parent->rectangle.width;
-		r2.height = (uint16_t)(parent->rectangle.height - r.height -
-							   conf.window_gap - conf.border_width);
-		/* parent->first_child->rectangle	= r;
-		parent->second_child->rectangle = r2; */
-
-		parent->first_child->rectangle =
-			((parent->second_child->client) &&
-			 IS_FLOATING(parent->second_child->client))
-				? parent->rectangle
-			: ((parent->first_child->client) &&
-			   IS_FLOATING(parent->first_child->client))
-				? parent->first_child->floating_rectangle
-				: r;
-		parent->second_child->rectangle =
-			((parent->first_child->client) &&
-			 IS_FLOATING(parent->first_child->client))
-				? parent->rectangle
-			: ((parent->second_child->client) &&
-			   IS_FLOATING(parent->second_child->client))
-				? parent->second_child->floating_rectangle
-				: r2;
-	}
-
-	if (IS_INTERNAL(parent->first_child)) {
-		apply_master_layout(parent->first_child);
-	}
-
-	if (IS_INTERNAL(parent->second_child)) {
-		apply_master_layout(parent->second_child);
-	}
+	layout_walk(parent, place_master);
 }
 
 /* master_layout - initializes and applies the master layout to the tree.
  *
  * This func sets up the initial rectangles for the master and stack areas,
  * marks the appropriate node as the master, and then calls
- * apply_master_layout to recursively apply the layout to the entire tree.
+ * apply_master_layout to apply the layout to the entire tree.
  */
 static void
 master_layout(node_t *root, node_t *n)
 {
-	const double   ratio		= 0.70;
-
-	rectangle_t	   usable		= get_usable_area(curr_monitor);
-	const uint16_t master_width = (uint16_t)(usable.width * ratio);
-	const uint16_t r_width		= (uint16_t)(usable.width * (1 - ratio));
+	rectangle_t	   usable = get_usable_area(curr_monitor);
+	const uint16_t master_width =
+		(uint16_t)RATIO_APPLY(usable.width, MASTER_RATIO);
+	const uint16_t r_width = (uint16_t)(usable.width - master_width);
 
 	/* find a node to be master if not provided */
 	if (n == NULL) {
@@ -1386,32 +1825,12 @@ master_clean_up(node_t *root)
 
 /* apply_stack_layout - applies the stack layout to a given tree .
  *
- * recursively applies the stack layout to a node and its
- * children in the tree. In a stack layout, all windows occupy
- * the same space, effectively stacking on top of each other. */
+ * In a stack layout, all windows occupy the same space, effectively
+ * stacking on top of each other. */
 void
 apply_stack_layout(node_t *root)
 {
-	if (root == NULL)
-		return;
-
-	if (root->first_child == NULL && root->second_child == NULL) {
-		return;
-	}
-
-	if (root->first_child) {
-		root->first_child->rectangle = root->rectangle;
-		if (IS_INTERNAL(root->first_child)) {
-			apply_stack_layout(root->first_child);
-		}
-	}
-
-	if (root->second_child) {
-		root->second_child->rectangle = root->rectangle;
-		if (IS_INTERNAL(root->second_child)) {
-			apply_stack_layout(root->second_child);
-		}
-	}
+	layout_walk(root, place_stack);
 }
 
 /**
@@ -1479,6 +1898,7 @@ grid_layout(node_t *root)
 void
 apply_layout(desktop_t *d, layout_t t)
 {
+	spatial_invalidate();
 	d->layout	 = t;
 	node_t *root = d->tree;
 	master_clean_up(root);
@@ -1570,9 +1990,9 @@ delete_node_with_external_sibling(node_t *node)
 			grandparent->second_child->second_child = NULL;
 		}
 	}
-	_FREE_(external_node);
-	_FREE_(node->client);
-	_FREE_(node);
+	pool_node_free(external_node);
+	pool_client_free(node->client);
+	pool_node_free(node);
 	return 0;
 }
 
@@ -1671,9 +2091,9 @@ delete_node_with_internal_sibling(node_t *node, desktop_t *d)
 		}
 	}
 
-	_FREE_(internal_sibling);
-	_FREE_(node->client);
-	_FREE_(node);
+	pool_node_free(internal_sibling);
+	pool_client_free(node->client);
+	pool_node_free(node);
 	return 0;
 }
 
@@ -1696,8 +2116,8 @@ delete_floating_node(node_t *node, desktop_t *d)
 		p->second_child = NULL;
 	}
 	node->parent = NULL;
-	_FREE_(node->client);
-	_FREE_(node);
+	pool_client_free(node->client);
+	pool_node_free(node);
 	assert(p->first_child == NULL);
 	assert(p->second_child == NULL);
 #ifdef _DEBUG__
@@ -1722,6 +2142,7 @@ delete_floating_node(node_t *node, desktop_t *d)
 void
 delete_node(node_t *node, desktop_t *d)
 {
+	spatial_invalidate();
 	if (node == NULL || node->client == NULL || d->tree == NULL) {
 		_LOG_(ERROR, "node to be deleted is null");
 		return;
@@ -1759,8 +2180,13 @@ delete_node(node_t *node, desktop_t *d)
 		/*d->node = NULL;*/
 	}
 
-	_FREE_(node->client);
-	_FREE_(node);
+	winmap_entry_t *e = winmap_get(node->client->window);
+	if (e && e->node == node) {
+		release_client(node->client);
+		winmap_remove(node->client->window);
+	}
+	pool_client_free(node->client);
+	pool_node_free(node);
 
 	/*if (!check) {
 		d->node = n;
@@ -1947,6 +2373,7 @@ in_right_subtree(node_t *rc, node_t *n)
 void
 dynamic_resize(node_t *n, resize_t t)
 {
+	spatial_invalidate();
 	const int16_t step = 5;
 	if (n == NULL || n->parent == NULL || IS_ROOT(n)) {
 		return;
@@ -2077,6 +2504,102 @@ find_any_leaf(node_t *root)
 	return NULL;
 }
 
+/* puts n where old is in parent, or at the top of d when old is the root */
+static void
+replace_child(desktop_t *d, node_t *parent, node_t *old, node_t *n)
+{
+	n->parent = parent;
+	if (parent == NULL)
+		d->tree = n;
+	else if (parent->first_child == old)
+		parent->first_child = n;
+	else
+		parent->second_child = n;
+}
+
+static void
+visit_leaves(const node_t *n, void (*fn)(const node_t *, void *), void *arg)
+{
+	if (n == NULL)
+		return;
+	if (n->client) {
+		fn(n, arg);
+		return;
+	}
+	visit_leaves(n->first_child, fn, arg);
+	visit_leaves(n->second_child, fn, arg);
+}
+
+/* layout_as_moved - lays the tree of d out as if src had been unlinked and
+ * inserted at target (what dropping a drag on target does), hands every leaf
+ * to fn with its rectangle in that layout, then restores the tree.
+ *
+ * rather than working on a copy, the live nodes are rewired in place: the
+ * sibling of src takes its parent's slot like in unlink_node(), and that
+ * parent, now spare, stands in for the internal node insert_node() would
+ * create at target. nothing is allocated and no request is sent. the live
+ * rectangles are recomputed by arrange_tree() afterwards. */
+bool
+layout_as_moved(desktop_t *d,
+				node_t	  *src,
+				node_t	  *target,
+				void (*fn)(const node_t *, void *),
+				void	  *arg)
+{
+	if (d == NULL || d->tree == NULL || src == NULL || target == NULL ||
+		src == target || src->parent == NULL || target->client == NULL)
+		return false;
+
+	node_t *p = src->parent;
+	node_t *s = get_sibling(src);
+	if (s == NULL)
+		return false;
+
+	node_t *const	   root		 = d->tree;
+	node_t *const	   gp		 = p->parent;
+	const bool		   src_first = (p->first_child == src);
+	const node_type_t  p_type	 = p->node_type;
+	const node_type_t  s_type	 = s->node_type;
+	const node_type_t  t_type	 = target->node_type;
+	const split_type_t p_split	 = p->split_type;
+	const ratio_t	   p_ratio	 = p->split_ratio;
+
+	/* unlink src */
+	replace_child(d, gp, p, s);
+	if (gp == NULL)
+		s->node_type = ROOT_NODE;
+
+	/* split target, it keeps its slot's split settings like in insert_node */
+	node_t *const tp = target->parent;
+	replace_child(d, tp, target, p);
+	p->node_type	  = tp ? INTERNAL_NODE : ROOT_NODE;
+	p->first_child	  = target;
+	p->second_child	  = src;
+	p->split_type	  = target->split_type;
+	p->split_ratio	  = target->split_ratio;
+	target->parent	  = p;
+	target->node_type = EXTERNAL_NODE;
+
+	arrange_tree(d->tree, d->layout);
+	visit_leaves(d->tree, fn, arg);
+
+	/* and back, in reverse */
+	replace_child(d, tp, p, target);
+	replace_child(d, gp, s, p);
+	p->first_child	  = src_first ? src : s;
+	p->second_child	  = src_first ? s : src;
+	p->node_type	  = p_type;
+	p->split_type	  = p_split;
+	p->split_ratio	  = p_ratio;
+	s->parent		  = p;
+	s->node_type	  = s_type;
+	target->node_type = t_type;
+	d->tree			  = root;
+
+	arrange_tree(d->tree, d->layout);
+	return true;
+}
+
 /* unlink_node - removes a node from the tree while keeping the structure
  * intact.
  *
@@ -2091,6 +2614,7 @@ find_any_leaf(node_t *root)
 bool
 unlink_node(node_t *n, desktop_t *d)
 {
+	spatial_invalidate();
 	if (d == NULL || n == NULL) {
 		return false;
 	}
@@ -2124,7 +2648,7 @@ unlink_node(node_t *n, desktop_t *d)
 
 	parent->second_child = NULL;
 	parent->first_child	 = NULL;
-	_FREE_(parent);
+	pool_node_free(parent);
 	n->parent = NULL;
 	return true;
 }
@@ -2140,12 +2664,14 @@ unlink_node(node_t *n, desktop_t *d)
  * 3. Otherwise:
  *   - Finds a spot in the tree (a leaf), converts it into an internal node,
  *		and then insert the node in there.
+ * m is the monitor that owns d, the window map is pointed at both.
  * Note:
  * - Doesn't touch visibility or focus; that's handled outside. */
 bool
-transfer_node(node_t *node, desktop_t *d)
+transfer_node(node_t *node, desktop_t *d, monitor_t *m)
 {
-	if (node == NULL || d == NULL) {
+	spatial_invalidate();
+	if (node == NULL || d == NULL || m == NULL) {
 		return false;
 	}
 
@@ -2157,7 +2683,7 @@ transfer_node(node_t *node, desktop_t *d)
 
 	if (is_tree_empty(d->tree)) {
 		rectangle_t r = {0};
-		calculate_base_rect(&r, curr_monitor);
+		calculate_base_rect(&r, m);
 		node->node_type	   = ROOT_NODE;
 		d->tree			   = node;
 		d->tree->rectangle = r;
@@ -2172,6 +2698,7 @@ transfer_node(node_t *node, desktop_t *d)
 		d->tree->second_child->node_type = EXTERNAL_NODE;
 		d->tree->client					 = NULL;
 		d->tree->first_child->parent = d->tree->second_child->parent = d->tree;
+		winmap_relink(d->tree, d->tree->first_child);
 	} else {
 		node_t *leaf = find_any_leaf(d->tree);
 		if (leaf == NULL) {
@@ -2186,13 +2713,16 @@ transfer_node(node_t *node, desktop_t *d)
 		leaf->first_child->parent	 = leaf;
 		leaf->first_child->node_type = EXTERNAL_NODE;
 		leaf->client				 = NULL;
-		leaf->second_child			 = node;
+		winmap_relink(leaf, leaf->first_child);
+		leaf->second_child = node;
 		if (leaf->second_child == NULL) {
 			return false;
 		}
 		leaf->second_child->parent	  = leaf;
 		leaf->second_child->node_type = EXTERNAL_NODE;
 	}
+
+	winmap_put(node->client->window, node, d, m);
 	return true;
 }
 
@@ -2296,6 +2826,7 @@ prev_node(node_t *n)
 void
 flip_node(node_t *node)
 {
+	spatial_invalidate();
 	if (node->parent == NULL) {
 		return;
 	}
@@ -2393,6 +2924,7 @@ get_focused_node(node_t *n)
 int
 swap_node(node_t *n)
 {
+	spatial_invalidate();
 	if (n->parent == NULL)
 		return -1;
 
@@ -2444,188 +2976,99 @@ is_within_range(rectangle_t *rect1, rectangle_t *rect2, direction_t d)
 	}
 }
 
+/* distance from node to current in direction d, current being in range */
+static int
+neighbor_distance(const node_t *node, const node_t *current, direction_t d)
+{
+	switch (d) {
+	case LEFT:
+		return node->rectangle.x -
+			   (current->rectangle.x + current->rectangle.width);
+	case RIGHT:
+		return current->rectangle.x -
+			   (node->rectangle.x + node->rectangle.width);
+	case UP:
+		return node->rectangle.y -
+			   (current->rectangle.y + current->rectangle.height);
+	case DOWN:
+		return current->rectangle.y -
+			   (node->rectangle.y + node->rectangle.height);
+	default: return INT16_MAX;
+	}
+}
+
+static void
+closest_in(node_t		*current,
+		   node_t		*node,
+		   direction_t	 d,
+		   node_t	   **closest,
+		   int			*closest_distance)
+{
+	if (current == NULL || current == node)
+		return;
+	if (IS_EXTERNAL(current) && current->client &&
+		is_within_range(&node->rectangle, &current->rectangle, d)) {
+		int distance = neighbor_distance(node, current, d);
+		if (distance < *closest_distance) {
+			*closest_distance = distance;
+			*closest		  = current;
+		}
+	}
+	closest_in(current->first_child, node, d, closest, closest_distance);
+	closest_in(current->second_child, node, d, closest, closest_distance);
+}
+
 /* find_closest_neighbor - find the closest neighbor node to a given node in
  * a specific direction. It is used to move focus to another node using the
  * keyboard
  *
- * searches through the tree (using a bfs) to
- * find the closest external node (a leaf node with a client) that is within
- * a certain range of the given node in the specified direction. It keeps
- * track of the closest node found and returns it.
+ * walks the tree depth first to find the closest external node (a leaf node
+ * with a client) that is within a certain range of the given node in the
+ * specified direction. ties go to the first leaf in tree order, same as
+ * spatial_neighbor.
+ *
+ * only used when the node is not in the window map, cycle_win normally
+ * asks the desktop's spatial index.
  *
  * If no closest node is found, it returns NULL */
 static node_t *
 find_closest_neighbor(node_t *root, node_t *node, direction_t d)
 {
-	if (root == NULL)
-		return NULL;
-
 	node_t *closest			 = NULL;
 	int		closest_distance = INT16_MAX;
-
-	node_t *queue[50];
-	int		front = 0, rear = 0;
-	queue[rear++] = root;
-
-	while (front < rear) {
-		node_t *current = queue[front++];
-		if (current == node)
-			continue;
-		if (IS_EXTERNAL(current) && current->client &&
-			is_within_range(&node->rectangle, &current->rectangle, d)) {
-			int distance;
-			switch (d) {
-			case LEFT:
-				distance = node->rectangle.x -
-						   (current->rectangle.x + current->rectangle.width);
-				break;
-			case RIGHT:
-				distance = current->rectangle.x -
-						   (node->rectangle.x + node->rectangle.width);
-				break;
-			case UP:
-				distance = node->rectangle.y -
-						   (current->rectangle.y + current->rectangle.height);
-				break;
-			case DOWN:
-				distance = current->rectangle.y -
-						   (node->rectangle.y + node->rectangle.height);
-				break;
-			default: distance = INT16_MAX; break;
-			}
-			if (distance < closest_distance) {
-				closest_distance = distance;
-				closest			 = current;
-			}
-		}
-		if (current->first_child)
-			queue[rear++] = current->first_child;
-		if (current->second_child)
-			queue[rear++] = current->second_child;
-	}
+	closest_in(root, node, d, &closest, &closest_distance);
 	return closest;
 }
 
 /* cycle_win - cycles focus to the nearest window in a specified direction.
  *
- * calls find_closest_neighbor` to get the closest node in the
- * specified direction.
+ * asks the spatial index of the node's desktop for the closest node in the
+ * specified direction, falling back to find_closest_neighbor` when the
+ * desktop is not known. when several leaves are equally close the first one
+ * in depth-first tree order wins; this used to be breadth-first order, which
+ * could pick a shallower leaf further right or down in the tree.
  *
  * If either the root or the neighbor can't be found, it logs an error and
  * returns `NULL`. */
 node_t *
 cycle_win(node_t *node, direction_t d)
 {
-	node_t *root = find_tree_root(node);
-	if (root == NULL) {
-		_LOG_(ERROR, "could not find root of tree");
-		return NULL;
+	winmap_entry_t *e =
+		node->client ? winmap_get(node->client->window) : NULL;
+	node_t *neighbor = NULL;
+	if (e && e->desktop) {
+		neighbor = spatial_neighbor(e->desktop, node, d);
+	} else {
+		node_t *root = find_tree_root(node);
+		if (root == NULL) {
+			_LOG_(ERROR, "could not find root of tree");
+			return NULL;
+		}
+		neighbor = find_closest_neighbor(root, node, d);
 	}
-	node_t *neighbor = find_closest_neighbor(root, node, d);
 	if (neighbor == NULL) {
 		_LOG_(ERROR, "could not find neighbor node");
 		return NULL;
 	}
 	return neighbor;
 }
-
-/* is_closer_node - check if a new node is closer to the target node than
- * the current node in the specified direction. */
-static bool
-is_closer_node(node_t *current, node_t *new_node, node_t *node, direction_t d)
-{
-	if (current == NULL)
-		return true;
-
-	switch (d) {
-	case LEFT:
-		return new_node->rectangle.x > current->rectangle.x &&
-			   new_node->rectangle.x < node->rectangle.x;
-	case RIGHT:
-		return new_node->rectangle.x < current->rectangle.x &&
-			   new_node->rectangle.x > node->rectangle.x;
-	case UP:
-		return new_node->rectangle.y > current->rectangle.y &&
-			   new_node->rectangle.y < node->rectangle.y;
-	case DOWN:
-		return new_node->rectangle.y < current->rectangle.y &&
-			   new_node->rectangle.y > node->rectangle.y;
-	default: return false;
-	}
-}
-
-static node_t *
-find_neighbor(node_t *root, node_t *node, direction_t d)
-{
-	if (root == NULL || root == node)
-		return NULL;
-
-	node_t *best_node = NULL;
-	if (root->client) {
-		switch (d) {
-		case LEFT:
-			if (root->rectangle.x < node->rectangle.x &&
-				root->rectangle.x + root->rectangle.width <=
-					node->rectangle.x &&
-				(node->rectangle.y <
-					 root->rectangle.y + root->rectangle.height &&
-				 node->rectangle.y + node->rectangle.height >
-					 root->rectangle.y)) {
-				if (is_closer_node(best_node, root, node, d)) {
-					best_node = root;
-				}
-			}
-			break;
-		case RIGHT:
-			if (root->rectangle.x > node->rectangle.x + node->rectangle.width &&
-				(node->rectangle.y <
-					 root->rectangle.y + root->rectangle.height &&
-				 node->rectangle.y + node->rectangle.height >
-					 root->rectangle.y)) {
-				if (is_closer_node(best_node, root, node, d)) {
-					best_node = root;
-				}
-			}
-			break;
-		case UP:
-			if (root->rectangle.y < node->rectangle.y &&
-				root->rectangle.y + root->rectangle.height <=
-					node->rectangle.y &&
-				(node->rectangle.x <
-					 root->rectangle.x + root->rectangle.width &&
-				 node->rectangle.x + node->rectangle.width >
-					 root->rectangle.x)) {
-				if (is_closer_node(best_node, root, node, d)) {
-					best_node = root;
-				}
-			}
-			break;
-		case DOWN:
-			if (root->rectangle.y >
-					node->rectangle.y + node->rectangle.height &&
-				(node->rectangle.x <
-					 root->rectangle.x + root->rectangle.width &&
-				 node->rectangle.x + node->rectangle.width >
-					 root->rectangle.x)) {
-				if (is_closer_node(best_node, root, node, d)) {
-					best_node = root;
-				}
-			}
-			break;
-		default: break;
-		}
-	}
-	if (root->first_child) {
-		node_t *child_result = find_neighbor(root->first_child, node, d);
-		if (child_result && is_closer_node(best_node, child_result, node, d)) {
-			best_node = child_result;
-		}
-	}
-	if (root->second_child) {
-		node_t *child_result = find_neighbor(root->second_child, node, d);
-		if (child_result && is_closer_node(best_node, child_result, node, d)) {
-			best_node = child_result;
-		}
-	}
-	return best_node;
-}
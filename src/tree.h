@@ -45,22 +45,25 @@ node_t *get_sibling(node_t *n);
 node_t *find_leaf_at_point(node_t *root, int16_t x, int16_t y);
 node_t *clone_tree(node_t *n, node_t *p);
 bool unlink_node(node_t *node, desktop_t *d);
+bool layout_as_moved(desktop_t *d, node_t *src, node_t *target, void (*fn)(const node_t *, void *), void *arg);
 void dynamic_resize(node_t *n, resize_t t);
 void apply_master_layout(node_t *parent);
 void apply_default_layout(node_t *root);
 void apply_stack_layout(node_t *root);
+void layout_free(void);
 void update_focus(node_t *root, node_t *n);
 void flip_node(node_t *node);
 void resize_subtree(node_t *parent);
 void apply_layout(desktop_t *d, layout_t t);
 void free_tree(node_t *root);
 void restack(void);
+void restack_note_raise(xcb_window_t win);
 void restackv2(node_t *root);
 void delete_node(node_t *node, desktop_t *d);
 void insert_node(node_t *current_node, node_t *new_node, layout_t layout);
 void arrange_tree(node_t *tree, layout_t l);
 void log_tree_nodes(node_t *node);
-bool transfer_node(node_t *, desktop_t *);
+bool transfer_node(node_t *, desktop_t *, monitor_t *);
 bool is_tree_empty(const node_t *root);
 bool client_exist(node_t *cn, xcb_window_t id);
 bool has_floating_window(node_t *root);
@@ -69,5 +72,7 @@ int hide_windows(node_t *tree);
 int show_windows(node_t *tree);
 int swap_node(node_t *root);
 int render_tree_nomap(node_t *node);
+int render_desktop(desktop_t *d, bool do_map);
+void render_set_free(desktop_t *d);
 /* clang-format off */
 #endif /* ZWM_TREE_H */
@@ -33,6 +33,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <xcb/randr.h>
+#include <xcb/sync.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_event.h>
 #include <xcb/xcb_ewmh.h>
@@ -52,6 +53,19 @@
 #define FOCUS_FOLLOW_POINTER true		   /* default focus follows mouse */
 #define FOCUS_FOLLOW_SPAWN	 false		   /* default focus follows spawn */
 #define RESTORE_LAST_FOCUS	 false		   /* default restore last window */
+#define ATOMIC_TRANSITIONS	 false		   /* default server grab transitions */
+#define OUTLINE_MODE		 false		   /* default wireframe move/resize */
+#define DRAG_OVERLAY		 false		   /* default drop zone drag preview */
+#define TRANSITION_MAX_HOLD	 50 /* ms a transition may hold the server */
+#define TRANSITION_MAX_MISS	 3	/* overruns in a row before giving up */
+#define FRAME_US_DEFAULT	 16667 /* 60Hz, when the refresh rate is unknown */
+#define SYNC_TIMEOUT_MS		 100 /* ms to wait for a sync ack */
+#define SPATIAL_MAX_CELLS	 (1 << 20) /* point grid cap, scan beyond it */
+#define RESIZE_BAND			 8	/* px around a split that grab a resize */
+#define SPAN_ALL			 (1 << 16) /* from INT16_MIN, covers all int16_t */
+#define MASTER_RATIO		 RATIO_OF(7, 10) /* master share of the width */
+#define POOL_SLAB_OBJS		 64	 /* nodes/clients per pool slab */
+#define ATOM_TABLE_SIZE		 32	 /* power of 2, > twice the atoms mapped */
 
 /* type aliases */
 typedef xcb_connection_t	  xcb_conn_t;
@@ -59,6 +73,7 @@ typedef xcb_generic_error_t	  xcb_error_t;
 typedef xcb_void_cookie_t	  xcb_cookie_t;
 typedef xcb_ewmh_connection_t xcb_ewmh_conn_t;
 typedef xcb_generic_event_t	  xcb_event_t;
+typedef uint32_t			  ratio_t; /* fixed point fraction, see RATIO_ONE */
 
 typedef enum {
 	HORIZONTAL_TYPE,
@@ -141,6 +156,49 @@ typedef struct {
 	uint16_t current_x, current_y;
 } posxy_t;
 
+/* requests tracked by the deferred x error ring in zwm.c */
+typedef enum {
+	XREQ_NONE = 0,
+	XREQ_RESIZE,	  /* ConfigureWindow width/height */
+	XREQ_MOVE,		  /* ConfigureWindow x/y */
+	XREQ_GEOMETRY,	  /* ConfigureWindow x/y/width/height/border */
+	XREQ_CONFIGURE,	  /* any other ConfigureWindow */
+	XREQ_MAP,		  /* MapWindow */
+	XREQ_CHANGE_ATTR, /* ChangeWindowAttributes */
+	XREQ_EVENT_MASK,  /* ChangeWindowAttributes (client event mask) */
+	XREQ_INPUT_FOCUS, /* SetInputFocus */
+	XREQ_STACK,		  /* ConfigureWindow stack mode */
+	XREQ_UNMAP,		  /* UnmapWindow */
+	XREQ_PROPERTY,	  /* ChangeProperty */
+	XREQ_SYNC,		  /* XSync alarm requests */
+	XREQ_GRAB_KEY,	  /* GrabKey */
+	XREQ_UNGRAB_KEY,  /* UngrabKey */
+	XREQ_GRAB_BUTTON, /* GrabButton */
+	XREQ_UNGRAB_BTN,  /* UngrabButton */
+} xreq_op_t;
+
+/* an in-flight unchecked request. errors come back through the event queue
+ * and are matched to their owner by sequence number */
+typedef struct {
+	uint32_t	 sequence;
+	xcb_window_t window;
+	xreq_op_t	 op;
+} xreq_t;
+
+/* work deferred to the commit at the end of an event batch */
+typedef enum {
+	DIRTY_NONE		  = 0,
+	DIRTY_LAYOUT	  = 1 << 0, /* some desktop_t has dirty set */
+	DIRTY_STACK		  = 1 << 1, /* restack() */
+	DIRTY_CLIENT_LIST = 1 << 2, /* _NET_CLIENT_LIST */
+} dirty_t;
+
+/* one queued map/unmap in a visibility batch */
+typedef struct {
+	xcb_window_t window;
+	bool		 visible;
+} vis_change_t;
+
 /* defines a rectangle (the window area or the tile/section area).
  * note: x and y can be signed (negative or positive), for example when a
  * portion of a window goes out of the visible area of the screen.
@@ -248,15 +306,32 @@ typedef enum {
 	LAYER_FULLSCREEN = 4,
 } layer_t;
 
+/* the last state committed to the server for a client. render paths compare
+ * against it and only send requests for what actually changed */
+typedef struct {
+	rectangle_t rect;		  /* last geometry sent */
+	uint32_t	border_color; /* last border pixel sent */
+	uint16_t	border_width; /* last border width sent */
+	bool		rect_valid;	  /* rect has been committed at least once */
+	bool		border_valid; /* border_width has been committed */
+	bool		color_valid;  /* border_color has been committed */
+	bool		mapped;		  /* last map request was a map, not an unmap */
+} shadow_t;
+
 /* defines the client, like an opened application like firefox of a text editor.
  * every leaf node in the tree contains a non-null client, internal nodes ALWAYS
  * have null clients.
  */
-typedef struct {
+typedef struct client_t client_t;
+struct client_t {
 	/*char			 class_name[MAXLEN];*/
 	/*char			 wm_name[MAXLEN];*/
 	xcb_window_t	   window;
 	xcb_window_t	   transient_for; /* from WM_TRANSIENT_FOR (0 if none) */
+	client_t		  *transient_parent; /* managed client of transient_for */
+	uint16_t		   n_transients;	 /* clients whose parent is this one */
+	uint8_t			   transient_depth;	 /* 0 = toplevel, 1 = direct transient */
+	layer_t			   layer;			 /* cached compute_layer() */
 	xcb_atom_t		   type;
 	uint32_t		   border_width;
 	uint32_t		   mru_seq; /* bump on focus/raise */
@@ -266,7 +341,32 @@ typedef struct {
 	ewmh_window_type_t ewmh_type; /* from _NET_WM_WINDOW_TYPE */
 	state_t			   state;
 	bool			   override_redirect; /* from X attributes */
-} client_t;
+	shadow_t		   shadow;			  /* last committed server state */
+	xcb_sync_counter_t sync_counter; /* _NET_WM_SYNC_REQUEST_COUNTER or 0 */
+	xcb_sync_alarm_t   sync_alarm;	 /* fires when the counter catches up */
+	uint64_t		   sync_value;	 /* last value asked for */
+	uint64_t		   sync_sent;	 /* ms the request went out, 0 if acked */
+};
+
+/* everything a MapRequest needs to know about a new window. the requests are
+ * all sent before any reply is read, so managing a window costs one round
+ * trip rather than one per property */
+typedef struct {
+	rectangle_t		   geometry;	  /* from GetGeometry */
+	xcb_size_hints_t   size_hints;	  /* from WM_NORMAL_HINTS */
+	xcb_window_t	   transient_for; /* from WM_TRANSIENT_FOR (0 if none) */
+	xcb_window_t	   pointer_child; /* root child under the cursor */
+	xcb_sync_counter_t sync_counter;  /* 0 unless _NET_WM_SYNC_REQUEST */
+	ewmh_state_t	   ewmh_state;	  /* from _NET_WM_STATE */
+	ewmh_window_type_t ewmh_type;	  /* from _NET_WM_WINDOW_TYPE */
+	int16_t			   pointer_x;
+	int16_t			   pointer_y;
+	char			   class_name[MAXLEN]; /* from WM_CLASS */
+	bool			   override_redirect;  /* from X attributes */
+	bool			   has_geometry;
+	bool			   has_size_hints;
+	bool			   has_pointer;
+} window_props_t;
 
 typedef struct {
 	client_t *c;
@@ -291,7 +391,7 @@ struct node_t {
 	rectangle_t floating_rectangle;
 	node_type_t node_type;	  /* node type */
 	split_type_t split_type;  /* split orientation for DEFAULT layout */
-	double		 split_ratio; /* split ratio for DEFAULT layout */
+	ratio_t		 split_ratio; /* split ratio for DEFAULT layout, 0 = half */
 	bool		 is_focused;  /* whether or not this guy is focused */
 	bool		 is_master;	  /* whether this node is the master node */
 };
@@ -309,7 +409,10 @@ typedef struct {
 	layout_t	 layout;	 /* the layout (master, default, stack) */
 	bool		 is_focused; /* whether this is focused, only focused desktops
 							  * are rendered */
+	bool		 dirty;		 /* needs a render at the next commit */
 	char name[DLEN]; /* the name, it stringfeis the index of this desktop */
+	struct leaf_index_t *index; /* leaf rects for spatial queries, lazy */
+	struct render_set_t *drawn; /* what the last render committed, lazy */
 } desktop_t;
 
 /* monitor representation (also a linked list of monitors).
@@ -327,6 +430,10 @@ struct monitor_t {
 	xcb_window_t	   root;		/* the root window on this monitor */
 	uint32_t		   id;			/* monitor identifier, used with xinerama */
 	uint32_t		   mru_counter; /* per-monitor MRU counter */
+	xcb_window_t	  *stack;		/* committed stacking order, bottom first */
+	uint32_t		   stack_len;	/* windows in stack */
+	uint32_t		   stack_cap;	/* allocated slots in stack */
+	uint32_t		   frame_us;	/* refresh interval, 0 until queried */
 	uint16_t		   n_of_desktops; /* total desktops, defined in
 									   * the config file  */
 	char			   name[DLEN];	  /* monitor name (e.g. HDMI or eDP) */
@@ -336,6 +443,100 @@ struct monitor_t {
 	bool			   is_primary;	  /* primary monitor */
 };
 
+/* rectangles as packed per-field arrays, scanned with SIMD by spatial.c */
+typedef struct {
+	int32_t *x, *y; /* top left corners */
+	int32_t *w, *h; /* sizes */
+	size_t	 n;		/* rectangles */
+	size_t	 cap;	/* room in each array */
+} rect_soa_t;
+
+/* the client leaves of a tree, in tree order */
+typedef struct {
+	node_t	 **nodes; /* the leaves */
+	uint8_t	  *tiled; /* 1 if the client is not floating */
+	rect_soa_t rects; /* their rectangles */
+} leaf_set_t;
+
+/* gap math shared by every split of one layout pass (tree.c) */
+typedef struct {
+	int32_t shrink; /* taken off a side before the ratio is applied */
+	int32_t step;	/* from the end of the first child to the second */
+} split_gaps_t;
+
+/* flattened leaves of a desktop tree for point and directional queries,
+ * see spatial.c */
+typedef struct leaf_index_t leaf_index_t;
+struct leaf_index_t {
+	uint32_t   epoch;		/* layout epoch it was built at */
+	uint32_t   version;		/* winmap version it was built at */
+	leaf_set_t cur;			/* leaves the index below was built from */
+	leaf_set_t next;		/* scratch for the next rebuild */
+	uint16_t  *by_edge[4];	/* leaf ids sorted by left/right/top/bottom */
+	int32_t	  *xs, *ys;		/* distinct x and y edges of tiled leaves */
+	size_t	   nx, ny;		/* how many of each */
+	size_t	   edge_cap;	/* room in by_edge, xs and ys */
+	uint16_t  *cells;		/* grid between the edges, leaf id + 1 or 0 */
+	size_t	   cell_cap;	/* room in cells */
+};
+
+/* client leaves as a render commits them: target rectangle and border */
+typedef struct {
+	node_t	 **nodes;  /* the leaves, in tree order */
+	uint16_t  *border; /* border width each is committed with */
+	rect_soa_t rects;  /* rectangle each is committed to */
+} drawn_set_t;
+
+/* the last render of a desktop, see render_desktop in tree.c */
+typedef struct render_set_t render_set_t;
+struct render_set_t {
+	uint32_t	version; /* shadow version right after that render */
+	bool		valid;	 /* cur was rendered without errors */
+	bool		mapped;	 /* the render also mapped the clients */
+	drawn_set_t cur;	 /* what it committed */
+	drawn_set_t next;	 /* scratch for the next render */
+};
+
+/* a slot in the window id index (winmap.c) */
+typedef struct {
+	xcb_window_t window;  /* XCB_NONE marks an empty slot */
+	node_t		*node;	  /* the leaf holding this window's client */
+	desktop_t	*desktop; /* the desktop whose tree holds the leaf */
+	monitor_t	*monitor; /* the monitor owning that desktop */
+} winmap_entry_t;
+
+/* a slot in the sync alarm index (winmap.c) */
+typedef struct {
+	xcb_sync_alarm_t alarm;	 /* XCB_NONE marks an empty slot */
+	client_t		*client; /* the client the alarm reports for */
+} alarm_entry_t;
+
+/* a block of POOL_SLAB_OBJS objects carved by pool.c */
+typedef struct pool_slab_t pool_slab_t;
+struct pool_slab_t {
+	pool_slab_t *next; /* next slab of the same pool */
+	char		*objs; /* first object, right after the header */
+};
+
+/* fixed size object pool, free objects are threaded through their first
+ * bytes */
+typedef struct {
+	size_t		 obj_size;	  /* object size rounded to max alignment */
+	pool_slab_t *slabs;		  /* every slab of this pool */
+	void		*free_list;	  /* next object to hand out */
+	size_t		 live;		  /* objects handed out */
+	size_t		 n_slabs;	  /* slabs currently held */
+	size_t		 heap_allocs; /* slabs ever malloc'd */
+} pool_t;
+
+/* pool counters, see pool_stats() */
+typedef struct {
+	size_t live_nodes;	 /* node_t in use */
+	size_t live_clients; /* client_t in use */
+	size_t slabs;		 /* slabs held by both pools */
+	size_t heap_allocs;	 /* slab mallocs since startup */
+} pool_stats_t;
+
 /* window manager global state */
 typedef struct {
 	xcb_connection_t	  *connection;	/* xcb connection */
@@ -379,6 +580,28 @@ struct conf_key_t {
 	xcb_keysym_t keysym;	 /* key symbol */
 };
 
+/* a key grab on the root window */
+typedef struct {
+	uint16_t	  mod;	   /* modifier mask */
+	xcb_keycode_t keycode; /* key code */
+} key_grab_t;
+
+/* the server's keyboard mapping, see get_keymap() in zwm.c */
+typedef struct {
+	xcb_keysym_t *syms; /* per keysyms for each keycode, from min */
+	xcb_keycode_t min;	/* first keycode */
+	xcb_keycode_t max;	/* last keycode */
+	uint8_t		  per;	/* keysyms per keycode */
+} keymap_t;
+
+/* one slot of the keybinding hash, keyed by (lock-cleaned mod, keysym) */
+typedef struct {
+	uint16_t	 mod;		 /* modifier mask without lock */
+	xcb_keysym_t keysym;	 /* key symbol */
+	int (*execute)(arg_t *); /* action function, NULL for a free slot */
+	arg_t *arg;				 /* function arguments */
+} key_slot_t;
+
 /* function mapping structure */
 typedef struct {
 	char *func_name;		 /* function name */
@@ -403,8 +626,25 @@ typedef struct {
 	bool	 restore_last_focus;
 	/* restore previously focused window when switching
 								desktops (if layout != STACK) */
+	bool	 atomic_transitions; /* grab the server during transitions */
+	bool	 outline_mode;		 /* wireframe instead of live resize */
+	bool	 drag_overlay;		 /* drop zone overlay while dragging */
 } config_t;
 
+/* where a window would go if the drag was dropped on some target */
+typedef struct {
+	xcb_window_t window; /* tiled window that moves */
+	rectangle_t	 rect;	 /* its rectangle after the drop */
+} preview_rect_t;
+
+/* drag preview memoized per drop target, see drag.c */
+typedef struct {
+	xcb_window_t target; /* window of the target leaf */
+	size_t		 first;	 /* first of its rects in the rect buffer */
+	size_t		 count;	 /* number of rects */
+	rectangle_t	 src;	 /* where the dragged window itself lands */
+} preview_entry_t;
+
 /* drag state helps tracks active drag session */
 typedef struct {
 	xcb_window_t window;   /* window being dragged */
@@ -429,10 +669,13 @@ typedef struct {
 	int16_t		 start_y;
 	rectangle_t	 start_rect;
 	split_type_t split_type;
-	double		 start_ratio;
+	ratio_t		 start_ratio;
 	int16_t		 first_size;
 	int16_t		 avail;
 	uint8_t		 edges;
+	int16_t		 cur_x; /* latest pointer position, applied on next frame */
+	int16_t		 cur_y;
+	bool		 pending; /* cur_x/cur_y not committed yet */
 } mouse_state_t;
 
 typedef struct strut_window_node_t {
@@ -462,10 +705,20 @@ typedef struct {
 	queue_node_t *rear;	 /* rear of queue */
 } queue_t;
 
+typedef int (*event_handler_t)(const xcb_generic_event_t *);
+
 /* event handler registration structure */
 typedef struct {
-	uint8_t type;
-	int (*handle)(const xcb_generic_event_t *);
+	uint8_t			type;
+	event_handler_t handle;
 } event_handler_entry_t;
 
+/* what an atom means in a client message, one slot of the atom table */
+typedef struct {
+	xcb_atom_t			  atom;
+	client_message_type_t message; /* as a client message type */
+	window_state_type_t	  state;   /* as a _NET_WM_STATE request */
+	ewmh_state_t		  flag;	   /* as a _NET_WM_STATE bit */
+} atom_entry_t;
+
 #endif /* ZWM_TYPE_H */
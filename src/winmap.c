@@ -0,0 +1,383 @@
+/*
+ * BSD 2-Clause License
+ * Copyright (c) 2024, Yazeed Alharthi
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *	  1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ *
+ *	  2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "winmap.h"
+#include "helper.h"
+#include "type.h"
+#include "zwm.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* winmap - window id -> {node, desktop, monitor} index over every managed
+ * client on every monitor and desktop.
+ *
+ * open addressing with linear probing. deletion shifts the following run
+ * back instead of leaving tombstones, so a lookup stops at the first empty
+ * slot and stays short no matter how many windows come and go.
+ *
+ * the index also keeps its windows in the order they were first added, which
+ * is the mapping order _NET_CLIENT_LIST wants, plus a version that changes
+ * whenever that list does, and a second one that also changes when a window
+ * moves to another desktop.
+ *
+ * a second, smaller table of the same kind maps XSync alarms back to their
+ * clients, so an AlarmNotify is one lookup too.
+ *
+ * only live trees are indexed. the drag preview works on clones of the same
+ * clients, so updates made from tree.c check that the entry still points at
+ * the node being touched before changing it */
+
+#define WINMAP_MIN_CAP 64
+
+static winmap_entry_t *slots = NULL;
+static uint32_t		   cap	 = 0; /* power of two, or 0 before first put */
+static uint32_t		   count = 0;
+static xcb_window_t	  *order = NULL; /* windows in insertion order */
+static uint32_t		   order_len	 = 0;
+static uint32_t		   order_cap	 = 0;
+static uint32_t		   order_version = 0;
+static uint32_t		   place_version = 0;
+static alarm_entry_t  *alarm_slots	 = NULL;
+static uint32_t		   alarm_cap	 = 0; /* power of two, or 0 */
+static uint32_t		   alarm_count	 = 0;
+
+static inline uint32_t
+home_slot(xcb_window_t win, uint32_t mask)
+{
+	/* ids are handed out sequentially per client, mix them so neighbouring
+	 * windows don't pile into one run */
+	uint32_t h = win;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h & mask;
+}
+
+static winmap_entry_t *
+probe(winmap_entry_t *table, uint32_t size, xcb_window_t win)
+{
+	const uint32_t mask = size - 1;
+	uint32_t	   i	= home_slot(win, mask);
+	while (table[i].window != XCB_NONE && table[i].window != win) {
+		i = (i + 1) & mask;
+	}
+	return &table[i];
+}
+
+static bool
+grow(void)
+{
+	uint32_t		new_cap = cap ? cap << 1 : WINMAP_MIN_CAP;
+	winmap_entry_t *t = (winmap_entry_t *)calloc(new_cap, sizeof(*t));
+	if (t == NULL) {
+		_LOG_(ERROR, "cannot grow window index to %u slots", new_cap);
+		return false;
+	}
+	for (uint32_t i = 0; i < cap; i++) {
+		if (slots[i].window != XCB_NONE) {
+			*probe(t, new_cap, slots[i].window) = slots[i];
+		}
+	}
+	_FREE_(slots);
+	slots = t;
+	cap	  = new_cap;
+	return true;
+}
+
+winmap_entry_t *
+winmap_get(xcb_window_t win)
+{
+	if (cap == 0 || win == XCB_NONE) {
+		return NULL;
+	}
+	winmap_entry_t *e = probe(slots, cap, win);
+	return e->window == win ? e : NULL;
+}
+
+static bool
+order_append(xcb_window_t win)
+{
+	if (order_len == order_cap) {
+		uint32_t	  n = order_cap ? order_cap * 2 : WINMAP_MIN_CAP;
+		xcb_window_t *o = (xcb_window_t *)realloc(order, n * sizeof(*o));
+		if (o == NULL) {
+			_LOG_(ERROR, "cannot grow client order to %u windows", n);
+			return false;
+		}
+		order	  = o;
+		order_cap = n;
+	}
+	order[order_len++] = win;
+	order_version++;
+	return true;
+}
+
+/* order_remove - closing a window shifts the tail down by one slot. swapping
+ * the last window into the hole would be cheaper, but it breaks the mapping
+ * order EWMH asks for, and the list is only window ids */
+static void
+order_remove(xcb_window_t win)
+{
+	for (uint32_t i = 0; i < order_len; i++) {
+		if (order[i] == win) {
+			memmove(&order[i],
+					&order[i + 1],
+					(order_len - i - 1) * sizeof(*order));
+			order_len--;
+			order_version++;
+			return;
+		}
+	}
+}
+
+bool
+winmap_put(xcb_window_t win, node_t *node, desktop_t *d, monitor_t *m)
+{
+	if (win == XCB_NONE) {
+		return false;
+	}
+	/* keep the load factor under 3/4 */
+	if ((count + 1) * 4 > cap * 3 && !grow()) {
+		return false;
+	}
+	winmap_entry_t *e = probe(slots, cap, win);
+	if (e->window == XCB_NONE) {
+		if (!order_append(win)) {
+			return false;
+		}
+		count++;
+	}
+	if (e->desktop != d) {
+		place_version++;
+	}
+	*e = (winmap_entry_t){
+		.window = win, .node = node, .desktop = d, .monitor = m};
+	return true;
+}
+
+void
+winmap_remove(xcb_window_t win)
+{
+	winmap_entry_t *e = winmap_get(win);
+	if (e == NULL) {
+		return;
+	}
+
+	const uint32_t mask = cap - 1;
+	uint32_t	   hole = (uint32_t)(e - slots);
+	uint32_t	   j	= hole;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (slots[j].window == XCB_NONE) {
+			break;
+		}
+		/* an entry may fill the hole only if the hole lies between its home
+		 * slot and where it sits now, otherwise lookups would miss it */
+		uint32_t home = home_slot(slots[j].window, mask);
+		if (((j - home) & mask) >= ((j - hole) & mask)) {
+			slots[hole] = slots[j];
+			hole		= j;
+		}
+	}
+	slots[hole] = (winmap_entry_t){0};
+	count--;
+	place_version++;
+	order_remove(win);
+}
+
+/* winmap_relink - a client moved from one leaf to another inside the same
+ * tree, e.g. when insert_node pushes it down into a new first child */
+void
+winmap_relink(node_t *from, node_t *to)
+{
+	if (to == NULL || to->client == NULL) {
+		return;
+	}
+	winmap_entry_t *e = winmap_get(to->client->window);
+	if (e && e->node == from) {
+		e->node = to;
+	}
+}
+
+/* winmap_drop_tree - forget every client of a tree that is about to be freed */
+void
+winmap_drop_tree(node_t *root)
+{
+	if (root == NULL) {
+		return;
+	}
+	if (root->client) {
+		winmap_entry_t *e = winmap_get(root->client->window);
+		if (e && e->node == root) {
+			release_client(root->client);
+			winmap_remove(root->client->window);
+		}
+	}
+	winmap_drop_tree(root->first_child);
+	winmap_drop_tree(root->second_child);
+}
+
+static alarm_entry_t *
+alarm_probe(alarm_entry_t *table, uint32_t size, xcb_sync_alarm_t alarm)
+{
+	const uint32_t mask = size - 1;
+	uint32_t	   i	= home_slot(alarm, mask);
+	while (table[i].alarm != XCB_NONE && table[i].alarm != alarm) {
+		i = (i + 1) & mask;
+	}
+	return &table[i];
+}
+
+static bool
+alarm_grow(void)
+{
+	uint32_t	   new_cap = alarm_cap ? alarm_cap << 1 : WINMAP_MIN_CAP;
+	alarm_entry_t *t	   = (alarm_entry_t *)calloc(new_cap, sizeof(*t));
+	if (t == NULL) {
+		_LOG_(ERROR, "cannot grow alarm index to %u slots", new_cap);
+		return false;
+	}
+	for (uint32_t i = 0; i < alarm_cap; i++) {
+		if (alarm_slots[i].alarm != XCB_NONE) {
+			*alarm_probe(t, new_cap, alarm_slots[i].alarm) = alarm_slots[i];
+		}
+	}
+	_FREE_(alarm_slots);
+	alarm_slots = t;
+	alarm_cap	= new_cap;
+	return true;
+}
+
+bool
+winmap_alarm_put(xcb_sync_alarm_t alarm, client_t *c)
+{
+	if (alarm == XCB_NONE) {
+		return false;
+	}
+	if ((alarm_count + 1) * 4 > alarm_cap * 3 && !alarm_grow()) {
+		return false;
+	}
+	alarm_entry_t *e = alarm_probe(alarm_slots, alarm_cap, alarm);
+	if (e->alarm == XCB_NONE) {
+		alarm_count++;
+	}
+	*e = (alarm_entry_t){.alarm = alarm, .client = c};
+	return true;
+}
+
+client_t *
+winmap_alarm_get(xcb_sync_alarm_t alarm)
+{
+	if (alarm_cap == 0 || alarm == XCB_NONE) {
+		return NULL;
+	}
+	alarm_entry_t *e = alarm_probe(alarm_slots, alarm_cap, alarm);
+	return e->alarm == alarm ? e->client : NULL;
+}
+
+/* same backward shift as winmap_remove */
+void
+winmap_alarm_remove(xcb_sync_alarm_t alarm)
+{
+	if (alarm_cap == 0 || alarm == XCB_NONE) {
+		return;
+	}
+	alarm_entry_t *e = alarm_probe(alarm_slots, alarm_cap, alarm);
+	if (e->alarm != alarm) {
+		return;
+	}
+
+	const uint32_t mask = alarm_cap - 1;
+	uint32_t	   hole = (uint32_t)(e - alarm_slots);
+	uint32_t	   j	= hole;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (alarm_slots[j].alarm == XCB_NONE) {
+			break;
+		}
+		uint32_t home = home_slot(alarm_slots[j].alarm, mask);
+		if (((j - home) & mask) >= ((j - hole) & mask)) {
+			alarm_slots[hole] = alarm_slots[j];
+			hole			  = j;
+		}
+	}
+	alarm_slots[hole] = (alarm_entry_t){0};
+	alarm_count--;
+}
+
+/* winmap_foreach - calls fn on every entry. fn must not add or remove
+ * entries */
+void
+winmap_foreach(void (*fn)(winmap_entry_t *, void *), void *arg)
+{
+	for (uint32_t i = 0; i < cap; i++) {
+		if (slots[i].window != XCB_NONE) {
+			fn(&slots[i], arg);
+		}
+	}
+}
+
+/* winmap_order - every indexed window, oldest first */
+const xcb_window_t *
+winmap_order(uint32_t *len)
+{
+	*len = order_len;
+	return order;
+}
+
+uint32_t
+winmap_version(void)
+{
+	return order_version;
+}
+
+/* winmap_place_version - changes whenever a window is added, removed or put
+ * on another desktop */
+uint32_t
+winmap_place_version(void)
+{
+	return place_version;
+}
+
+void
+winmap_free(void)
+{
+	_FREE_(slots);
+	_FREE_(order);
+	_FREE_(alarm_slots);
+	alarm_cap	= 0;
+	alarm_count = 0;
+	cap		  = 0;
+	count	  = 0;
+	order_len = 0;
+	order_cap = 0;
+	order_version++;
+	place_version++;
+}
@@ -0,0 +1,50 @@
+/*
+ * BSD 2-Clause License
+ * Copyright (c) 2024, Yazeed Alharthi
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *	  1. Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ *
+ *	  2. Redistributions in binary form must reproduce the above copyright
+ *	  notice, this list of conditions and the following disclaimer in the
+ *	  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ZWM_WINMAP_H
+#define ZWM_WINMAP_H
+
+#include "type.h"
+
+/* clang-format off */
+winmap_entry_t *winmap_get(xcb_window_t win);
+bool winmap_put(xcb_window_t win, node_t *node, desktop_t *d, monitor_t *m);
+void winmap_remove(xcb_window_t win);
+void winmap_relink(node_t *from, node_t *to);
+void winmap_drop_tree(node_t *root);
+void winmap_foreach(void (*fn)(winmap_entry_t *, void *), void *arg);
+const xcb_window_t *winmap_order(uint32_t *len);
+uint32_t winmap_version(void);
+uint32_t winmap_place_version(void);
+bool winmap_alarm_put(xcb_sync_alarm_t alarm, client_t *c);
+client_t *winmap_alarm_get(xcb_sync_alarm_t alarm);
+void winmap_alarm_remove(xcb_sync_alarm_t alarm);
+void winmap_free(void);
+/* clang-format on */
+
+#endif /* ZWM_WINMAP_H */
@@ -33,11 +33,17 @@
 #include "config_parser.h"
 #include "drag.h"
 #include "helper.h"
+#include "outline.h"
+#include "pool.h"
 #include "queue.h"
+#include "spatial.h"
 #include "tree.h"
 #include "type.h"
+#include "winmap.h"
 #include <X11/keysym.h>
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -45,12 +51,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_cursor.h>
 #include <xcb/xcb_ewmh.h>
 #include <xcb/xcb_icccm.h>
-#include <xcb/xcb_keysyms.h>
+#include <xcb/sync.h>
 #include <xcb/xinerama.h>
 #include <xcb/xproto.h>
 
@@ -61,7 +68,10 @@
 #define S_NOTIFY		(XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY)
 #define S_REDIRECT		(XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT)
 
+#define WINDOW_BORDER	(XCB_CONFIG_WINDOW_BORDER_WIDTH)
+
 #define MOVE_RESIZE		(WINDOW_X | WINDOW_Y | WINDOW_W | WINDOW_H)
+#define GEOMETRY		(MOVE_RESIZE | WINDOW_BORDER)
 #define MOVE			(WINDOW_X | WINDOW_Y)
 #define RESIZE			(WINDOW_W | WINDOW_H)
 #define SUBSTRUCTURE	(S_NOTIFY | S_REDIRECT)
@@ -90,6 +100,8 @@
 #define WM_NAME			   "zwm"
 #define WM_CLASS_NAME	   "null"
 #define WM_INSTANCE_NAME   "null"
+#define XREQ_RING_SIZE	   256 /* must be a power of two */
+#define EVENT_BATCH_MAX	   128 /* events drained per loop iteration */
 
 wm_t				 *wm			 = NULL;
 monitor_t			 *prim_monitor	 = NULL;
@@ -108,9 +120,42 @@ bool ignore_ewmh_struts = false; /* this is hardcoded for now, plan on making it
 config_t			  conf					= {0};
 volatile sig_atomic_t should_shutdown		= 0;
 uint8_t				  randr_base			= 0;
+bool				  using_xsync			= false;
+uint8_t				  sync_base				= 0;
 uint64_t			  last_desk_switch_time = 0;
 xcb_cursor_t		  cursors[CURSOR_MAX];
 static mouse_state_t  mouse_state = {0};
+/* unchecked requests in flight, indexed by sequence number */
+static xreq_t		  xreq_ring[XREQ_RING_SIZE];
+/* interned once in setup_ewmh, used on every map/unmap */
+static xcb_atom_t	  wm_state_atom = XCB_NONE;
+/* set_visibility() queues here while a batch is open */
+static vis_change_t	 *vis_batch		= NULL;
+static size_t		  vis_batch_len = 0;
+static size_t		  vis_batch_cap = 0;
+static bool			  vis_batching	= false;
+/* server grab state of the outermost begin_transition() */
+static int			  transition_depth	 = 0;
+static bool			  transition_grabbed = false;
+static uint64_t		  transition_start	 = 0;
+static int			  transition_misses	 = 0;
+/* what the end of the current event batch still has to do */
+static dirty_t		  pending_dirty		 = DIRTY_NONE;
+/* moves whenever the geometry, border width or map state in some client's
+ * shadow changes, see render_desktop */
+static uint32_t		  shadow_writes		 = 0;
+/* paces interactive move/resize to the display refresh rate */
+static int			  frame_timer_fd	= -1;
+static bool			  frame_timer_armed = false;
+/* keyboard mapping, kept for the connection's lifetime. a mapping notify
+ * only fetches the keycodes it names again */
+static keymap_t			  keymap = {0};
+/* the active bindings, hashed by build_key_table() */
+static key_slot_t		 *key_table	  = NULL;
+static size_t			  key_table_mask = 0;
+/* what grab_keys() grabbed last, sorted */
+static key_grab_t		 *grabbed_keys	   = NULL;
+static size_t			  grabbed_keys_len = 0;
 
 /* clang-format off */
 
@@ -176,8 +221,9 @@ static const uint32_t _buttons_[] = {
 
 static monitor_t *get_focused_monitor();
 static int set_fullscreen(node_t *, bool);
-static int change_border_attr(xcb_conn_t *, xcb_window_t, uint32_t, uint32_t, bool);
-static int win_focus(xcb_window_t, bool);
+static int change_border_attr(client_t *, uint32_t, uint32_t, bool);
+static int commit_client_border(client_t *, uint32_t, uint16_t);
+static int win_focus(client_t *, bool);
 static void update_grabbed_window(node_t *, node_t *);
 static bool grab_pointer_for_mouse(cursor_t cursor_id);
 static void clear_mouse_state(void);
@@ -187,36 +233,66 @@ static bool start_floating_resize(node_t *n, int16_t x, int16_t y);
 static bool start_tiled_resize(node_t *n, int16_t x, int16_t y);
 static void handle_mouse_motion(int16_t x, int16_t y);
 static void finish_mouse_action(void);
+static void queue_mouse_motion(int16_t x, int16_t y);
+static void on_frame_timer(void);
+static void unlink_client_transients(client_t *c);
+static bool mouse_sync_busy(void);
+static void setup_xsync(void);
+static void build_dispatch_table(void);
+static void build_atom_table(void);
+static const atom_entry_t *atom_lookup(xcb_atom_t atom);
+static int handle_sync_alarm_notify(const xcb_event_t *event);
+static int handle_screen_change(const xcb_event_t *event);
 static void cancel_mouse_action(void);
-static double clamp_ratio(double ratio);
+static void commit_outline(void);
+static ratio_t clamp_ratio(ratio_t ratio);
 static bool is_resize_band_hit(node_t *parent, split_type_t split_type, int16_t x, int16_t y);
-static void ungrab_keys(xcb_conn_t *, xcb_window_t);
 static void arrange_trees(void);
 static int grab_keys(xcb_conn_t *, xcb_window_t);
 static desktop_t *init_desktop();
 static int ewmh_update_current_desktop(xcb_ewmh_conn_t *, int, uint32_t);
 static int ewmh_update_number_of_desktops(void);
+static void ewmh_update_client_list(void);
 static int set_active_window_name(xcb_window_t);
-static int change_border_attr(xcb_conn_t *, xcb_window_t, uint32_t, uint32_t, bool);
 static int change_window_attr(xcb_conn_t *, xcb_window_t, uint32_t, const void *);
 static int configure_window(xcb_conn_t *, xcb_window_t, uint16_t, const void *);
 static int set_input_focus(xcb_conn_t *, uint8_t, xcb_window_t, xcb_timestamp_t);
 static xcb_atom_t get_atom(char *, xcb_conn_t *);
 static bool window_exists(xcb_conn_t *, xcb_window_t);
 static int close_or_kill(xcb_window_t);
+static int kill_window(xcb_window_t);
+static node_t *find_node_global(xcb_window_t);
 static int switch_desktop(int);
 static int set_window_state(xcb_window_t win, xcb_icccm_wm_state_t state);
 static int update_net_wm_desktop(xcb_window_t win, uint32_t desktop);
 static ewmh_state_t ewmh_flag_for_atom(xcb_atom_t atom);
 static int update_net_wm_state_atom(xcb_window_t win, xcb_atom_t atom, bool set);
 static void update_client_ewmh_state(client_t *c, ewmh_state_t flag, bool set);
-static int handle_tiled_window_request(xcb_window_t, desktop_t *);
-static int handle_floating_window_request(xcb_window_t, desktop_t *);
+static void link_transient(client_t *c);
+static int handle_tiled_window_request(xcb_window_t, desktop_t *, const window_props_t *);
+static int handle_floating_window_request(xcb_window_t, desktop_t *, const window_props_t *);
+static void prefetch_window_props(xcb_window_t, window_props_t *);
+static ewmh_state_t net_wm_state_from_atoms(const xcb_atom_t *, uint32_t);
+static ewmh_window_type_t window_type_from_atoms(const xcb_atom_t *, uint32_t);
 
 static int handle_unmanaged_strut_window(xcb_window_t win);
 /* static int show_window(xcb_window_t win, node_t *n); */
-static int show_window(xcb_window_t win);
-static int hide_window(xcb_window_t win);
+static void stage_visibility(const vis_change_t *v,
+							 xcb_get_property_cookie_t ck);
+static int apply_visibility(const vis_change_t *v, size_t n);
+static void begin_transition(void);
+static void end_transition(void);
+static int do_switch_desktop(int);
+static bool find_key_binding(uint16_t	   state,
+							 xcb_keysym_t  k,
+							 int		 (**fn)(arg_t *),
+							 arg_t		 **arg);
+static int build_key_table(void);
+static keymap_t *get_keymap(xcb_conn_t *conn);
+static bool fetch_keymap(xcb_conn_t *conn, xcb_keycode_t first, uint16_t count);
+static xcb_keycode_t *get_keycode(xcb_keysym_t keysym, xcb_conn_t *conn);
+static size_t coalesce_events(xcb_event_t **batch, size_t n);
+static void commit_dirty(void);
 static xcb_get_geometry_reply_t *get_geometry(xcb_window_t win, xcb_conn_t *conn);
 static bool setup_desktops(void);
 static node_t *get_foucsed_desktop_tree(void);
@@ -235,6 +311,7 @@ static int handle_button_release(const xcb_event_t *);
 static int handle_focus_in(const xcb_event_t *);
 static int handle_property_notify(const xcb_event_t *);
 static int send_client_message(xcb_window_t, xcb_atom_t, xcb_atom_t, xcb_conn_t *);
+static void handle_x_error(const xcb_error_t *err);
 
 /* array of xcb events we need to handle -> {event, handler function} */
 static const event_handler_entry_t _handlers_[] = {
@@ -289,6 +366,12 @@ static const event_handler_entry_t _handlers_[] = {
 };
 /* clang-format on */
 
+/* _handlers_ plus the extension events, indexed by response type. filled by
+ * build_dispatch_table() once the extension event bases are known */
+static event_handler_t dispatch[256] = {NULL};
+/* the client message and _NET_WM_STATE atoms, see build_atom_table() */
+static atom_entry_t	   atom_table[ATOM_TABLE_SIZE] = {0};
+
 static void
 load_cursors(void)
 {
@@ -401,10 +484,12 @@ layout_handler(arg_t *arg)
 	if (arg->t == STACK && d->n_count < 2)
 		return 0;
 
+	begin_transition();
 	apply_layout(d, arg->t);
-	int ret = render_tree(d->tree);
-	restack();
-	return ret;
+	mark_desktop_dirty(d);
+	mark_dirty(DIRTY_STACK);
+	end_transition();
+	return 0;
 }
 
 /* useles after
@@ -428,17 +513,70 @@ render_trees(void)
 			continue;
 		}
 		for (int i = 0; i < curr->n_of_desktops; i++) {
-			if (is_tree_empty(curr->desktops[i]->tree))
-				continue;
-			if (curr->desktops[i]->is_focused)
-				render_tree(curr->desktops[i]->tree);
-			else /* keep X geometry correct for hidden desktops */
-				render_tree_nomap(curr->desktops[i]->tree);
+			if (!is_tree_empty(curr->desktops[i]->tree))
+				mark_desktop_dirty(curr->desktops[i]);
 		}
 		curr = curr->next;
 	}
 }
 
+void
+mark_dirty(dirty_t what)
+{
+	pending_dirty |= what;
+}
+
+uint32_t
+shadow_version(void)
+{
+	return shadow_writes;
+}
+
+/* the desktop is re-rendered once at the next commit, however many times
+ * it was marked before that */
+void
+mark_desktop_dirty(desktop_t *d)
+{
+	if (d == NULL)
+		return;
+	d->dirty = true;
+	pending_dirty |= DIRTY_LAYOUT;
+}
+
+/* the commit phase: runs once after every event batch (and at the end of a
+ * grabbed transition) and does the work handlers only marked, in order:
+ * render dirty desktops, restack, publish the client list, flush */
+static void
+commit_dirty(void)
+{
+	const dirty_t what = pending_dirty;
+	pending_dirty	   = DIRTY_NONE;
+
+	if (what & DIRTY_LAYOUT) {
+		for (monitor_t *m = head_monitor; m; m = m->next) {
+			for (int i = 0; m->desktops && i < m->n_of_desktops; i++) {
+				desktop_t *d = m->desktops[i];
+				if (!d->dirty)
+					continue;
+				d->dirty = false;
+				if (is_tree_empty(d->tree))
+					continue;
+				if (d->is_focused) {
+					if (render_desktop(d, true) != 0)
+						_LOG_(ERROR, "cannot render desktop %d", d->id);
+				} else { /* keep X geometry correct for hidden desktops */
+					render_desktop(d, false);
+				}
+			}
+		}
+	}
+	if (what & DIRTY_STACK)
+		restack();
+	if (what & DIRTY_CLIENT_LIST)
+		ewmh_update_client_list();
+	xcb_flush(wm->connection);
+}
+
 /* changes the state of a window between tiled and floating. */
 int
 change_state(arg_t *arg)
@@ -460,6 +598,7 @@ change_state(arg_t *arg)
 		if (IS_TILED(n->client))
 			return 0;
 		n->client->state = TILED;
+		refresh_client_layer(n->client);
 		if (n->rectangle.width >= n->rectangle.height) {
 			parent->first_child->rectangle.x = parent->rectangle.x;
 			parent->first_child->rectangle.y = parent->rectangle.y;
@@ -519,6 +658,7 @@ change_state(arg_t *arg)
 		n->floating_rectangle = rc;
 		_FREE_(g);
 		n->client->state = FLOATING;
+		refresh_client_layer(n->client);
 		if (parent) {
 			if (parent->first_child == n) {
 				parent->second_child->rectangle = parent->rectangle;
@@ -534,9 +674,9 @@ change_state(arg_t *arg)
 		}
 	}
 
-	int ret = render_tree(curr_monitor->desk->tree);
-	restack();
-	return ret;
+	mark_desktop_dirty(curr_monitor->desk);
+	mark_dirty(DIRTY_STACK);
+	return 0;
 }
 
 static xcb_ewmh_conn_t *
@@ -691,9 +831,8 @@ modfield_from_keysym(xcb_keysym_t keysym)
 	uint16_t						  modfield = 0;
 	xcb_keycode_t					 *keycodes = NULL, *mod_keycodes = NULL;
 	xcb_get_modifier_mapping_reply_t *reply = NULL;
-	xcb_key_symbols_t *symbols = xcb_key_symbols_alloc(wm->connection);
 
-	if ((keycodes = xcb_key_symbols_get_keycode(symbols, keysym)) == NULL ||
+	if ((keycodes = get_keycode(keysym, wm->connection)) == NULL ||
 		(reply = xcb_get_modifier_mapping_reply(
 			 wm->connection, xcb_get_modifier_mapping(wm->connection), NULL)) ==
 			NULL ||
@@ -720,7 +859,6 @@ modfield_from_keysym(xcb_keysym_t keysym)
 	}
 
 end:
-	xcb_key_symbols_free(symbols);
 	_FREE_(keycodes);
 	_FREE_(reply);
 	return modfield;
@@ -732,7 +870,10 @@ remove_property(xcb_connection_t *con,
 				xcb_atom_t		  prop,
 				xcb_atom_t		  atom)
 {
-	xcb_grab_server(con);
+	/* x grabs do not nest, don't drop an enclosing transition's grab */
+	const bool grab = !transition_grabbed;
+	if (grab)
+		xcb_grab_server(con);
 	xcb_get_property_cookie_t c = xcb_get_property(
 		con, false, win, prop, XCB_GET_PROPERTY_TYPE_ANY, 0, 4096);
 	xcb_get_property_reply_t *reply = xcb_get_property_reply(con, c, NULL);
@@ -766,7 +907,8 @@ remove_property(xcb_connection_t *con,
 release_grab:
 	if (reply)
 		_FREE_(reply);
-	xcb_ungrab_server(con);
+	if (grab)
+		xcb_ungrab_server(con);
 }
 
 /* stack win1 above win2 */
@@ -782,15 +924,8 @@ window_above(xcb_window_t win1, xcb_window_t win2)
 	uint16_t mask = XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE;
 	uint32_t values[] = {win2, XCB_STACK_MODE_ABOVE};
 	xcb_cookie_t cookie =
-		xcb_configure_window_checked(wm->connection, win1, mask, values);
-	xcb_error_t *err = xcb_request_check(wm->connection, cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "in stacking window %d: error code %d",
-			  win2,
-			  err->error_code);
-		_FREE_(err);
-	}
+		xcb_configure_window(wm->connection, win1, mask, values);
+	track_request(cookie, win1, XREQ_STACK);
 }
 
 /* stack win1 below win2 */
@@ -803,15 +938,8 @@ window_below(xcb_window_t win1, xcb_window_t win2)
 	uint16_t mask = XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE;
 	uint32_t values[] = {win2, XCB_STACK_MODE_BELOW};
 	xcb_cookie_t cookie =
-		xcb_configure_window_checked(wm->connection, win1, mask, values);
-	xcb_error_t *err = xcb_request_check(wm->connection, cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "in stacking window %d: error code %d",
-			  win2,
-			  err->error_code);
-		_FREE_(err);
-	}
+		xcb_configure_window(wm->connection, win1, mask, values);
+	track_request(cookie, win1, XREQ_STACK);
 }
 
 void
@@ -820,32 +948,21 @@ lower_window(xcb_window_t win)
 	uint32_t	 values[] = {XCB_STACK_MODE_BELOW};
 	uint16_t	 mask	  = XCB_CONFIG_WINDOW_STACK_MODE;
 	xcb_cookie_t cookie =
-		xcb_configure_window_checked(wm->connection, win, mask, values);
-	xcb_error_t *err = xcb_request_check(wm->connection, cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "in stacking window %d: error code %d",
-			  win,
-			  err->error_code);
-		_FREE_(err);
-	}
+		xcb_configure_window(wm->connection, win, mask, values);
+	track_request(cookie, win, XREQ_STACK);
 }
 
+/* raise_window - every raise of a managed window goes through here so the
+ * committed per-monitor order that restack diffs against stays in sync */
 void
 raise_window(xcb_window_t win)
 {
 	uint32_t	 values[] = {XCB_STACK_MODE_ABOVE};
 	uint16_t	 mask	  = XCB_CONFIG_WINDOW_STACK_MODE;
 	xcb_cookie_t cookie =
-		xcb_configure_window_checked(wm->connection, win, mask, values);
-	xcb_error_t *err = xcb_request_check(wm->connection, cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "in stacking window %d: error code %d",
-			  win,
-			  err->error_code);
-		_FREE_(err);
-	}
+		xcb_configure_window(wm->connection, win, mask, values);
+	track_request(cookie, win, XREQ_STACK);
+	restack_note_raise(win);
 }
 
 int
@@ -869,7 +986,8 @@ swap_node_wrapper(arg_t *arg)
 	if (swap_node(n) != 0)
 		return -1;
 
-	return render_tree(curr_monitor->desk->tree);
+	mark_desktop_dirty(curr_monitor->desk);
+	return 0;
 }
 
 /* transfer_node_wrapper - handles transferring a node between desktops.
@@ -917,7 +1035,7 @@ transfer_node_wrapper(arg_t *arg)
 		return -1;
 	}
 	if (unlink_node(node, od)) {
-		if (!transfer_node(node, nd)) {
+		if (!transfer_node(node, nd, curr_monitor)) {
 			_LOG_(ERROR, "could not transfer node.. abort");
 			return -1;
 		}
@@ -936,7 +1054,8 @@ transfer_node_wrapper(arg_t *arg)
 	if (!is_tree_empty(od->tree)) {
 		arrange_tree(od->tree, od->layout);
 	}
-	return render_tree(od->tree);
+	mark_desktop_dirty(od);
+	return 0;
 }
 
 int
@@ -991,12 +1110,8 @@ grow_floating_window(arg_t *arg)
 	*pos -= step;
 
 	grab_pointer(wm->root_window, false);
-	if (resize_window(n->client->window,
-					  n->floating_rectangle.width,
-					  n->floating_rectangle.height) != 0 ||
-		move_window(n->client->window,
-					n->floating_rectangle.x,
-					n->floating_rectangle.y) != 0) {
+	if (commit_client_geometry(
+			n->client, n->floating_rectangle, conf.border_width) != 0) {
 		return -1;
 	}
 	ungrab_pointer();
@@ -1026,12 +1141,8 @@ shrink_floating_window(arg_t *arg)
 	*dim -= (step * 2);
 	*pos += step;
 	grab_pointer(wm->root_window, false);
-	if (resize_window(n->client->window,
-					  n->floating_rectangle.width,
-					  n->floating_rectangle.height) != 0 ||
-		move_window(n->client->window,
-					n->floating_rectangle.x,
-					n->floating_rectangle.y) != 0) {
+	if (commit_client_geometry(
+			n->client, n->floating_rectangle, conf.border_width) != 0) {
 		return -1;
 	}
 	ungrab_pointer();
@@ -1065,9 +1176,8 @@ resize_floating_window(arg_t *arg)
 		*pos_to_adjust += delta / 2;
 	}
 	grab_pointer(wm->root_window, false);
-	if (resize_window(n->client->window,
-					  n->floating_rectangle.width,
-					  n->floating_rectangle.height) != 0) {
+	if (commit_client_geometry(
+			n->client, n->floating_rectangle, conf.border_width) != 0) {
 		return -1;
 	}
 	ungrab_pointer();
@@ -1115,7 +1225,7 @@ shift_floating_window(arg_t *arg)
 	}
 
 	grab_pointer(wm->root_window, false);
-	if (move_window(n->client->window, rect->x, rect->y) != 0) {
+	if (commit_client_geometry(n->client, *rect, conf.border_width) != 0) {
 		return -1;
 	}
 
@@ -1161,15 +1271,12 @@ set_fullscreen(node_t *n, bool flag)
 		r.width			 = m->rectangle.width;
 		r.height		 = m->rectangle.height;
 		n->client->state = FULLSCREEN;
-		if (change_border_attr(wm->connection,
-							   n->client->window,
-							   conf.normal_border_color,
-							   0,
-							   false) != 0) {
+		refresh_client_layer(n->client);
+		if (change_border_attr(n->client, conf.normal_border_color, 0, false) !=
+			0) {
 			return -1;
 		}
-		if (resize_window(n->client->window, r.width, r.height) != 0 ||
-			move_window(n->client->window, r.x, r.y) != 0) {
+		if (commit_client_geometry(n->client, r, 0) != 0) {
 			return -1;
 		}
 		xcb_cookie_t c	 = xcb_change_property_checked(wm->connection,
@@ -1192,8 +1299,8 @@ set_fullscreen(node_t *n, bool flag)
 
 	r				 = n->rectangle;
 	n->client->state = TILED;
-	if (resize_window(n->client->window, r.width, r.height) != 0 ||
-		move_window(n->client->window, r.x, r.y) != 0) {
+	refresh_client_layer(n->client);
+	if (commit_client_geometry(n->client, r, conf.border_width) != 0) {
 		return -1;
 	}
 	remove_property(wm->connection,
@@ -1201,16 +1308,14 @@ set_fullscreen(node_t *n, bool flag)
 					wm->ewmh->_NET_WM_STATE,
 					wm->ewmh->_NET_WM_STATE_FULLSCREEN);
 	update_client_ewmh_state(n->client, EWMH_STATE_FULLSCREEN, false);
-	if (change_border_attr(wm->connection,
-						   n->client->window,
+	if (change_border_attr(n->client,
 						   conf.normal_border_color,
 						   conf.border_width,
 						   true) != 0) {
 		return -1;
 	}
 out:
-	restack();
-	xcb_flush(wm->connection);
+	mark_dirty(DIRTY_STACK);
 	return 0;
 }
 /* change_colors is called when a user changes the border color in the config
@@ -1224,7 +1329,7 @@ change_colors(node_t *root)
 	 * param is set to true it applies the active_border_color, otherwise the
 	 * normal_border_color is chosen */
 	if (root->node_type != INTERNAL_NODE && root->client) {
-		if (win_focus(root->client->window, root->is_focused) != 0) {
+		if (win_focus(root->client, root->is_focused) != 0) {
 			_LOG_(ERROR, "cannot focus node");
 			return -1;
 		}
@@ -1273,12 +1378,12 @@ apply_monitor_layout_changes(monitor_t *m)
 			if (!ms && !(ms = find_any_leaf(tree)))
 				return;
 
-			ms->is_master			  = true;
-			const double ratio		  = 0.70;
+			ms->is_master		= true;
 
-			rectangle_t	 usable		  = get_usable_area(m);
-			uint16_t	 master_width = (uint16_t)(usable.width * ratio);
-			uint16_t	 r_width	  = (uint16_t)(usable.width * (1 - ratio));
+			rectangle_t usable	= get_usable_area(m);
+			uint16_t	master_width =
+				(uint16_t)RATIO_APPLY(usable.width, MASTER_RATIO);
+			uint16_t r_width = (uint16_t)(usable.width - master_width);
 
 			rectangle_t	 r1			  = {
 						   .x	   = (int16_t)(usable.x + conf.window_gap),
@@ -1328,12 +1433,13 @@ reload_config_wrapper(arg_t *arg)
 	uint32_t prev_active_border_color = conf.active_border_color;
 	uint32_t prev_normal_border_color = conf.normal_border_color;
 	int		 prev_virtual_desktops	  = conf.virtual_desktops;
+	transition_misses				  = 0;
 	/* clear the config data structures */
 	memset(&conf, 0, sizeof(config_t));
 
-	ungrab_keys(wm->connection, wm->root_window);
-	is_kgrabbed = false;
+	/* the grabs stay, grab_keys() only changes what the new config does */
 	free_keys();
+	_FREE_(key_table); /* points into the freed keys */
 	free_rules();
 	assert(key_head == NULL && rule_head == NULL);
 
@@ -1347,6 +1453,9 @@ reload_config_wrapper(arg_t *arg)
 		conf.focus_follow_spawn	  = FOCUS_FOLLOW_SPAWN;
 		conf.virtual_desktops	  = NUMBER_OF_DESKTOPS;
 		conf.restore_last_focus	  = RESTORE_LAST_FOCUS;
+		conf.atomic_transitions	  = ATOMIC_TRANSITIONS;
+		conf.outline_mode		  = OUTLINE_MODE;
+		conf.drag_overlay		  = DRAG_OVERLAY;
 		if (0 != grab_keys(wm->connection, wm->root_window)) {
 			_LOG_(ERROR, "cannot grab keys after reload");
 			return -1;
@@ -1362,6 +1471,7 @@ reload_config_wrapper(arg_t *arg)
 	bool desktop_changed = (prev_virtual_desktops != conf.virtual_desktops);
 
 	if (color_changed) {
+		outline_free(); /* recreated with the new color on next use */
 		monitor_t *current_monitor = head_monitor;
 		while (current_monitor) {
 			for (int j = 0; j < current_monitor->n_of_desktops; j++) {
@@ -1430,12 +1540,17 @@ reload_config_wrapper(arg_t *arg)
 					if (current_monitor->desktops[j]) {
 						if (!is_tree_empty(
 								current_monitor->desktops[j]->tree)) {
+							winmap_drop_tree(
+								current_monitor->desktops[j]->tree);
 							free_tree(current_monitor->desktops[j]->tree);
 							current_monitor->desktops[j]->tree = NULL;
 						}
+						spatial_free(current_monitor->desktops[j]);
+						render_set_free(current_monitor->desktops[j]);
 						_FREE_(current_monitor->desktops[j]);
 					}
 				}
+				pool_trim();
 				current_monitor->n_of_desktops = conf.virtual_desktops;
 				desktop_t **n				   = (desktop_t **)realloc(
 					 current_monitor->desktops,
@@ -1474,8 +1589,8 @@ reload_config_wrapper(arg_t *arg)
 	}
 
 out:
-	render_tree(curr_monitor->desk->tree);
-	xcb_flush(wm->connection);
+	mark_desktop_dirty(curr_monitor->desk);
+	pool_log_stats("reload");
 	return 0;
 }
 
@@ -1495,9 +1610,7 @@ gap_handler(arg_t *arg)
 		apply_monitor_layout_changes(current_monitor);
 		current_monitor = current_monitor->next;
 	}
-	render_tree(curr_monitor->desk->tree);
-	/* restack(); */
-	xcb_flush(wm->connection);
+	mark_desktop_dirty(curr_monitor->desk);
 	return 0;
 }
 
@@ -1511,9 +1624,8 @@ flip_node_wrapper(arg_t *arg)
 		return -1;
 
 	flip_node(node);
-	int ret = render_tree(tree);
-	/* restack(); */
-	return ret;
+	mark_desktop_dirty(curr_monitor->desk);
+	return 0;
 }
 
 int
@@ -1650,7 +1762,7 @@ traverse_stack_wrapper(arg_t *arg)
 	/*curr_monitor->desk->node = n;*/
 	if (n->client) {
 		n->client->mru_seq = get_next_mru_seq(curr_monitor);
-		restack();
+		mark_dirty(DIRTY_STACK);
 	}
 
 	return 0;
@@ -1670,35 +1782,6 @@ get_active_clients_size_prime()
 	return t;
 }
 
-static size_t
-get_active_clients_size(desktop_t **d, const int n)
-{
-	if (!d)
-		return -1;
-	size_t t = 0;
-	for (int i = 0; i < n; ++i) {
-		if (!d[i])
-			continue;
-		t += d[i]->n_count;
-	}
-	return t;
-}
-
-static void
-populate_client_array(node_t *root, xcb_window_t *arr, size_t *index)
-{
-	if (root == NULL)
-		return;
-
-	if (root->client && root->client->window != XCB_NONE) {
-		arr[*index] = root->client->window;
-		(*index)++;
-	}
-
-	populate_client_array(root->first_child, arr, index);
-	populate_client_array(root->second_child, arr, index);
-}
-
 static void
 ewmh_update_client_list(void)
 {
@@ -1724,36 +1807,18 @@ ewmh_update_client_list(void)
 	 * and introduces a whole new class of bugs.
 	 * ZWM intentionally avoids doing that.
 	 */
-	monitor_t *m	= head_monitor;
-	size_t	   size = 0;
-	while (m) {
-		if (!m->desktops)
-			continue;
-		size += get_active_clients_size(m->desktops, m->n_of_desktops);
-		m = m->next;
-	}
-	if (size == 0) {
-		xcb_ewmh_set_client_list(wm->ewmh, wm->screen_nbr, 0, NULL);
-		/* _LOG_(ERROR, "unable to get clients size"); */
+	static uint32_t published = UINT32_MAX;
+	const uint32_t	version	  = winmap_version();
+	if (version == published) {
 		return;
 	}
+
 	/* _NET_CLIENT_LIST_STACKING is maintained in restack(). */
-	xcb_window_t *active_clients =
-		(xcb_window_t *)malloc((size + 1) * sizeof(xcb_window_t));
-	if (active_clients == NULL) {
-		return;
-	}
-	size_t	   index = 0;
-	monitor_t *curr	 = head_monitor;
-	while (curr) {
-		for (int i = 0; i < curr->n_of_desktops; ++i) {
-			node_t *root = curr->desktops[i]->tree;
-			populate_client_array(root, active_clients, &index);
-		}
-		curr = curr->next;
-	}
-	xcb_ewmh_set_client_list(wm->ewmh, wm->screen_nbr, size, active_clients);
-	_FREE_(active_clients);
+	uint32_t			len		= 0;
+	const xcb_window_t *clients = winmap_order(&len);
+	xcb_ewmh_set_client_list(
+		wm->ewmh, wm->screen_nbr, len, (xcb_window_t *)clients);
+	published = version;
 }
 
 static int
@@ -1822,7 +1887,7 @@ get_wm_name(xcb_window_t win, char **out)
 static client_t *
 create_client(xcb_window_t win, xcb_atom_t wtype, xcb_conn_t *conn)
 {
-	client_t *c = (client_t *)malloc(sizeof(client_t));
+	client_t *c = pool_client_alloc();
 	if (c == 0x00)
 		return NULL;
 
@@ -1849,28 +1914,30 @@ _LOG_(INFO, "created client wm_name %s", c->wm_name);
 	c->props.input_hint		= false;
 	c->props.take_focus		= false;
 	c->mru_seq				= 0;
+	c->shadow				= (shadow_t){0};
+	shadow_writes++;
+	c->transient_for		= XCB_NONE;
+	c->transient_parent		= NULL;
+	c->n_transients			= 0;
+	c->transient_depth		= 0;
+	c->ewmh_state			= EWMH_STATE_NONE;
+	c->ewmh_type			= WINDOW_TYPE_NORMAL;
+	c->state				= TILED;
+	c->layer				= LAYER_NORMAL;
+	c->sync_counter			= XCB_NONE;
+	c->sync_alarm			= XCB_NONE;
+	c->sync_value			= 0;
+	c->sync_sent			= 0;
 	const uint32_t mask		= XCB_CW_EVENT_MASK;
 	const uint32_t values[] = {CLIENT_EVENT_MASK};
 	xcb_cookie_t   cookie =
-		xcb_change_window_attributes_checked(conn, c->window, mask, values);
-	xcb_error_t *err = xcb_request_check(conn, cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "error setting window attributes for client %u: %d",
-			  c->window,
-			  err->error_code);
-		_FREE_(err);
-		_FREE_(c);
-		exit(EXIT_FAILURE);
-	}
+		xcb_change_window_attributes(conn, c->window, mask, values);
+	track_request(cookie, c->window, XREQ_EVENT_MASK);
 
-	if (change_border_attr(wm->connection,
-						   win,
-						   conf.normal_border_color,
-						   conf.border_width,
-						   false) != 0) {
+	if (change_border_attr(
+			c, conf.normal_border_color, conf.border_width, false) != 0) {
 		_LOG_(ERROR, "failed to change border attr for window %d", win);
-		_FREE_(c);
+		pool_client_free(c);
 		return NULL;
 	}
 
@@ -1880,7 +1947,7 @@ _LOG_(INFO, "created client wm_name %s", c->wm_name);
 static desktop_t *
 init_desktop(void)
 {
-	desktop_t *d = (desktop_t *)malloc(sizeof(desktop_t));
+	desktop_t *d = (desktop_t *)calloc(1, sizeof(desktop_t));
 	if (d == 0x00)
 		return NULL;
 	d->id			= 0;
@@ -1888,6 +1955,9 @@ init_desktop(void)
 	d->n_count		= 0;
 	d->tree			= NULL;
 	d->last_focused = XCB_NONE;
+	d->dirty		= false;
+	d->index		= NULL;
+	d->drawn		= NULL;
 	/*d->node	  = NULL;*/
 	return d;
 }
@@ -1911,6 +1981,9 @@ init_monitor(void)
 	m->desktops	   = NULL;
 	m->desk		   = NULL;
 	m->mru_counter = 1;
+	m->stack	   = NULL;
+	m->stack_len   = 0;
+	m->stack_cap   = 0;
 	return m;
 }
 
@@ -2212,8 +2285,10 @@ recalculate_all_struts(void)
 
 	free(rep);
 
+	begin_transition();
 	arrange_trees();
 	render_trees();
+	end_transition();
 }
 
 static void
@@ -2613,14 +2688,19 @@ free_monitors(void)
 					free_tree(current->desktops[j]->tree);
 					current->desktops[j]->tree = NULL;
 				}
+				spatial_free(current->desktops[j]);
+				render_set_free(current->desktops[j]);
 				_FREE_(current->desktops[j]);
 			}
 		}
 		_FREE_(current->desktops);
+		_FREE_(current->stack);
 		_FREE_(current);
 		current = next;
 	}
 	head_monitor = NULL;
+	winmap_free();
+	pool_trim();
 }
 
 static void
@@ -2909,13 +2989,18 @@ destroy_monitor(monitor_t *m)
 			continue;
 		}
 		if (desktop->tree) {
+			winmap_drop_tree(desktop->tree);
 			free_tree(desktop->tree);
 			desktop->tree = NULL;
 		}
+		spatial_free(desktop);
+		render_set_free(desktop);
 		_FREE_(desktop);
 	}
 	_FREE_(m->desktops);
+	_FREE_(m->stack);
 	_FREE_(m);
+	pool_trim();
 	_LOG_(INFO, "monitor was destroyed.");
 }
 
@@ -2979,7 +3064,7 @@ merge_monitors(monitor_t *om, monitor_t *nm)
 				}
 
 				/* try to transfer the node. If transfer fails, abort */
-				if (!transfer_node(node, nd)) {
+				if (!transfer_node(node, nd, nm)) {
 					_LOG_(ERROR, "failed to transfer node... abort");
 					_FREE_(q);
 					return false;
@@ -3166,6 +3251,8 @@ handle_monitor_changes(void)
 	uint32_t m_change = 0 | _NONE; /* flags for post processing */
 	bool	 render	  = false;
 	update_monitors(&m_change);
+	/* modes may have changed, refresh intervals are queried again */
+	for (monitor_t *m = head_monitor; m; m = m->next) m->frame_us = 0;
 
 	if (m_change & _NONE) {
 		_LOG_(INFO, "no monitor changes was found");
@@ -3303,6 +3390,8 @@ setup_ewmh(void)
 	if (wm->ewmh == NULL) {
 		return false;
 	}
+	wm_state_atom = get_atom("WM_STATE", wm->connection);
+	build_atom_table();
 
 	xcb_atom_t	 net_atoms[] = {wm->ewmh->_NET_SUPPORTED,
 								wm->ewmh->_NET_SUPPORTING_WM_CHECK,
@@ -3317,6 +3406,7 @@ setup_ewmh(void)
 								wm->ewmh->_NET_WM_STRUT_PARTIAL,
 								wm->ewmh->_NET_WM_DESKTOP,
 								wm->ewmh->_NET_WM_STATE,
+								wm->ewmh->_NET_WM_SYNC_REQUEST,
 								/* wm->ewmh->_NET_WM_STATE_HIDDEN, */
 								/* wm->ewmh->_NET_WM_STATE_STICKY, */
 								wm->ewmh->_NET_WM_STATE_FULLSCREEN,
@@ -3387,6 +3477,16 @@ setup_wm(void)
 		_LOG_(ERROR, "error while setting up ewmh");
 		return false;
 	}
+
+	setup_xsync();
+	build_dispatch_table();
+
+	/* without it, interactive move/resize just isn't frame paced */
+	frame_timer_fd =
+		timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (frame_timer_fd < 0) {
+		_LOG_(ERROR, "cannot create frame timer: %s", strerror(errno));
+	}
 	/* load_cursors(); */
 	/* set_cursor(CURSOR_POINTER); */
 	/* init_pointer(); */
@@ -3408,46 +3508,96 @@ get_net_wm_state_mask(xcb_window_t win)
 		return EWMH_STATE_NONE;
 	}
 
-	for (unsigned i = 0; i < rep.atoms_len; ++i) {
-		xcb_atom_t a = rep.atoms[i];
-		if (a == wm->ewmh->_NET_WM_STATE_ABOVE)
-			mask |= EWMH_STATE_ABOVE;
-		else if (a == wm->ewmh->_NET_WM_STATE_BELOW)
-			mask |= EWMH_STATE_BELOW;
-		else if (a == wm->ewmh->_NET_WM_STATE_FULLSCREEN)
-			mask |= EWMH_STATE_FULLSCREEN;
-		else if (a == wm->ewmh->_NET_WM_STATE_MODAL)
-			mask |= EWMH_STATE_MODAL;
-		else if (a == wm->ewmh->_NET_WM_STATE_HIDDEN)
-			mask |= EWMH_STATE_HIDDEN;
-		else if (a == wm->ewmh->_NET_WM_STATE_STICKY)
-			mask |= EWMH_STATE_STICKY;
-		else if (a == wm->ewmh->_NET_WM_STATE_DEMANDS_ATTENTION)
-			mask |= EWMH_STATE_DEMANDS_ATTN;
-	}
-
+	mask = net_wm_state_from_atoms(rep.atoms, rep.atoms_len);
 	xcb_ewmh_get_atoms_reply_wipe(&rep);
 	return mask;
 }
 
+static ewmh_state_t
+net_wm_state_from_atoms(const xcb_atom_t *atoms, uint32_t len)
+{
+	ewmh_state_t mask = EWMH_STATE_NONE;
+	for (uint32_t i = 0; i < len; ++i) {
+		mask |= ewmh_flag_for_atom(atoms[i]);
+	}
+	return mask;
+}
+
+static inline uint32_t
+atom_slot(xcb_atom_t atom)
+{
+	/* fibonacci hashing, atoms are small and mostly consecutive */
+	return (uint32_t)(atom * 2654435761u) & (ATOM_TABLE_SIZE - 1);
+}
+
+static atom_entry_t *
+atom_insert(xcb_atom_t atom)
+{
+	uint32_t i = atom_slot(atom);
+	while (atom_table[i].atom != XCB_NONE && atom_table[i].atom != atom) {
+		i = (i + 1) & (ATOM_TABLE_SIZE - 1);
+	}
+	atom_table[i].atom = atom;
+	return &atom_table[i];
+}
+
+/* build_atom_table - maps every atom a client message or a _NET_WM_STATE
+ * request can name to what it means for us, so handling one is a single
+ * probe instead of a chain of comparisons */
+static void
+build_atom_table(void)
+{
+	const xcb_ewmh_conn_t *e = wm->ewmh;
+	memset(atom_table, 0, sizeof(atom_table));
+
+	atom_insert(e->_NET_CURRENT_DESKTOP)->message =
+		CLIENT_MESSAGE_CURRENT_DESKTOP;
+	atom_insert(e->_NET_WM_STATE)->message = CLIENT_MESSAGE_WINDOW_STATE;
+	atom_insert(e->_NET_ACTIVE_WINDOW)->message = CLIENT_MESSAGE_ACTIVE_WINDOW;
+	atom_insert(e->_NET_WM_DESKTOP)->message = CLIENT_MESSAGE_WINDOW_DESKTOP;
+	atom_insert(e->_NET_CLOSE_WINDOW)->message = CLIENT_MESSAGE_CLOSE_WINDOW;
+
+	atom_entry_t *s = atom_insert(e->_NET_WM_STATE_FULLSCREEN);
+	s->state		= STATE_FULLSCREEN;
+	s->flag			= EWMH_STATE_FULLSCREEN;
+	s				= atom_insert(e->_NET_WM_STATE_BELOW);
+	s->state		= STATE_BELOW;
+	s->flag			= EWMH_STATE_BELOW;
+	s				= atom_insert(e->_NET_WM_STATE_ABOVE);
+	s->state		= STATE_ABOVE;
+	s->flag			= EWMH_STATE_ABOVE;
+	s				= atom_insert(e->_NET_WM_STATE_HIDDEN);
+	s->state		= STATE_HIDDEN;
+	s->flag			= EWMH_STATE_HIDDEN;
+	s				= atom_insert(e->_NET_WM_STATE_STICKY);
+	s->state		= STATE_STICKY;
+	s->flag			= EWMH_STATE_STICKY;
+	s				= atom_insert(e->_NET_WM_STATE_DEMANDS_ATTENTION);
+	s->state		= STATE_DEMANDS_ATTENTION;
+	s->flag			= EWMH_STATE_DEMANDS_ATTN;
+	/* a state we track but don't act on */
+	atom_insert(e->_NET_WM_STATE_MODAL)->flag = EWMH_STATE_MODAL;
+}
+
+static const atom_entry_t *
+atom_lookup(xcb_atom_t atom)
+{
+	if (atom == XCB_NONE)
+		return NULL;
+	uint32_t i = atom_slot(atom);
+	while (atom_table[i].atom != XCB_NONE) {
+		if (atom_table[i].atom == atom)
+			return &atom_table[i];
+		i = (i + 1) & (ATOM_TABLE_SIZE - 1);
+	}
+	return NULL;
+}
+
 static ewmh_state_t
 ewmh_flag_for_atom(xcb_atom_t atom)
 {
-	if (atom == wm->ewmh->_NET_WM_STATE_ABOVE)
-		return EWMH_STATE_ABOVE;
-	if (atom == wm->ewmh->_NET_WM_STATE_BELOW)
-		return EWMH_STATE_BELOW;
-	if (atom == wm->ewmh->_NET_WM_STATE_FULLSCREEN)
-		return EWMH_STATE_FULLSCREEN;
-	if (atom == wm->ewmh->_NET_WM_STATE_MODAL)
-		return EWMH_STATE_MODAL;
-	if (atom == wm->ewmh->_NET_WM_STATE_HIDDEN)
-		return EWMH_STATE_HIDDEN;
-	if (atom == wm->ewmh->_NET_WM_STATE_STICKY)
-		return EWMH_STATE_STICKY;
-	if (atom == wm->ewmh->_NET_WM_STATE_DEMANDS_ATTENTION)
-		return EWMH_STATE_DEMANDS_ATTN;
-	return EWMH_STATE_NONE;
+	const atom_entry_t *e = atom_lookup(atom);
+	return e ? e->flag : EWMH_STATE_NONE;
 }
 
 static void
@@ -3459,6 +3609,7 @@ update_client_ewmh_state(client_t *c, ewmh_state_t flag, bool set)
 		c->ewmh_state |= flag;
 	else
 		c->ewmh_state &= ~flag;
+	refresh_client_layer(c);
 }
 
 static int
@@ -3498,194 +3649,543 @@ update_net_wm_state_atom(xcb_window_t win, xcb_atom_t atom, bool set)
 	return 0;
 }
 
+/* creates the alarm that reports when c has painted the last size it was
+ * asked for (_NET_WM_SYNC_REQUEST). it is created with events off: value 0
+ * is reached at once, which only makes the alarm trigger silently and go
+ * inactive. every send_sync_request() re-arms it with the new value and
+ * turns events on */
 static void
-fill_icccm_ewmh(client_t *c)
+setup_client_sync(client_t *c)
 {
-	/* 1) transient_for */
-	xcb_window_t			  transient = XCB_NONE;
-	xcb_get_property_cookie_t cv =
-		xcb_icccm_get_wm_transient_for(wm->connection, c->window);
-	const uint8_t r = xcb_icccm_get_wm_transient_for_reply(
-		wm->connection, cv, &transient, NULL);
-
-	c->transient_for = transient;
-
-	/* 2) attributes --> override_redirect */
-	xcb_get_window_attributes_cookie_t atc =
-		xcb_get_window_attributes(wm->connection, c->window);
-	xcb_get_window_attributes_reply_t *atr =
-		xcb_get_window_attributes_reply(wm->connection, atc, NULL);
-	c->override_redirect = (atr && atr->override_redirect);
-	free(atr);
+	if (!using_xsync || c->sync_counter == XCB_NONE ||
+		c->sync_alarm != XCB_NONE)
+		return;
 
-	/* 3) window type */
-	c->ewmh_type  = window_type(c->window);
+	const uint32_t mask = XCB_SYNC_CA_COUNTER | XCB_SYNC_CA_VALUE_TYPE |
+						  XCB_SYNC_CA_VALUE | XCB_SYNC_CA_TEST_TYPE |
+						  XCB_SYNC_CA_DELTA | XCB_SYNC_CA_EVENTS;
+	const uint32_t values[] = {
+		c->sync_counter,
+		XCB_SYNC_VALUETYPE_ABSOLUTE,
+		0, /* value hi */
+		0, /* value lo */
+		XCB_SYNC_TESTTYPE_POSITIVE_COMPARISON,
+		0, /* delta hi */
+		0, /* delta lo */
+		0, /* events */
+	};
+	c->sync_alarm	= xcb_generate_id(wm->connection);
+	xcb_cookie_t ck = xcb_sync_create_alarm(
+		wm->connection, c->sync_alarm, mask, values);
+	track_request(ck, c->window, XREQ_SYNC);
+	winmap_alarm_put(c->sync_alarm, c);
+}
+
+/* asks c to bump its sync counter once it has painted the configure that
+ * follows. a no-op for clients without the protocol */
+static void
+send_sync_request(client_t *c)
+{
+	if (c == NULL || c->sync_alarm == XCB_NONE)
+		return;
 
-	/* 4) _NET_WM_STATE --> bitmask */
-	c->ewmh_state = get_net_wm_state_mask(c->window);
+	xcb_conn_t *conn = wm->connection;
+	c->sync_value++;
+	const uint32_t v[] = {(uint32_t)(c->sync_value >> 32),
+						  (uint32_t)c->sync_value,
+						  1 /* events */};
+	const uint32_t mask = XCB_SYNC_CA_VALUE | XCB_SYNC_CA_EVENTS;
+	xcb_cookie_t   ck	= xcb_sync_change_alarm(conn, c->sync_alarm, mask, v);
+	track_request(ck, c->window, XREQ_SYNC);
+
+	xcb_client_message_event_t e = {0};
+	e.response_type				 = XCB_CLIENT_MESSAGE;
+	e.window					 = c->window;
+	e.type						 = wm->ewmh->WM_PROTOCOLS;
+	e.format					 = 32;
+	e.data.data32[0]			 = wm->ewmh->_NET_WM_SYNC_REQUEST;
+	e.data.data32[1]			 = XCB_CURRENT_TIME;
+	e.data.data32[2]			 = (uint32_t)c->sync_value;
+	e.data.data32[3]			 = (uint32_t)(c->sync_value >> 32);
+	xcb_send_event(
+		conn, false, c->window, XCB_EVENT_MASK_NO_EVENT, (const char *)&e);
+	c->sync_sent = get_time_millis();
+}
+
+/* true while c still owes an ack for its last sync request */
+static bool
+client_sync_busy(client_t *c)
+{
+	if (c == NULL || c->sync_sent == 0)
+		return false;
+	if (get_time_millis() - c->sync_sent < SYNC_TIMEOUT_MS)
+		return true;
+	c->sync_sent = 0; /* never answered, stop waiting for it */
+	return false;
 }
 
-int
-resize_window(xcb_window_t win, uint16_t width, uint16_t height)
+static bool
+subtree_sync_busy(node_t *n)
 {
-	if (win == 0 || win == XCB_NONE)
-		return 0;
+	if (n == NULL)
+		return false;
+	if (!IS_INTERNAL(n) && n->client)
+		return !IS_FLOATING(n->client) && client_sync_busy(n->client);
+	return subtree_sync_busy(n->first_child) ||
+		   subtree_sync_busy(n->second_child);
+}
 
-	const uint32_t values[] = {width, height};
-	xcb_cookie_t   cookie =
-		xcb_configure_window_checked(wm->connection, win, RESIZE, values);
+/* a client caught up with its sync counter. if a resize was held back
+ * waiting for it and no frame tick is due, apply it now */
+static int
+handle_sync_alarm_notify(const xcb_event_t *event)
+{
+	xcb_sync_alarm_notify_event_t *ev = (xcb_sync_alarm_notify_event_t *)event;
+	client_t					  *c  = winmap_alarm_get(ev->alarm);
+	if (c)
+		c->sync_sent = 0;
 
-	xcb_error_t *err = xcb_request_check(wm->connection, cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "error resizing window (ID %u): %s",
-			  win,
-			  strerror(err->error_code));
-		_FREE_(err);
-		return -1;
+	if (mouse_state.pending && !frame_timer_armed && !mouse_sync_busy()) {
+		mouse_state.pending = false;
+		handle_mouse_motion(mouse_state.cur_x, mouse_state.cur_y);
 	}
-
 	return 0;
 }
 
-int
-move_window(xcb_window_t win, int16_t x, int16_t y)
+static void
+setup_xsync(void)
 {
-	if (win == 0 || win == XCB_NONE) {
-		return 0;
+	xcb_conn_t						  *conn = wm->connection;
+	const xcb_query_extension_reply_t *ext =
+		xcb_get_extension_data(conn, &xcb_sync_id);
+	if (ext == NULL || !ext->present) {
+		_LOG_(INFO, "XSync is not available, resizes won't be synced");
+		return;
 	}
-
-	const uint32_t values[] = {x, y};
-	xcb_cookie_t   cookie =
-		xcb_configure_window_checked(wm->connection, win, MOVE, values);
-	xcb_error_t *err = xcb_request_check(wm->connection, cookie);
-
-	if (err) {
-		_LOG_(ERROR, "error moving window (ID %u): %d", win, err->error_code);
-		_FREE_(err);
-		return -1;
+	xcb_sync_initialize_reply_t *r = xcb_sync_initialize_reply(
+		conn,
+		xcb_sync_initialize(
+			conn, XCB_SYNC_MAJOR_VERSION, XCB_SYNC_MINOR_VERSION),
+		NULL);
+	if (r == NULL) {
+		_LOG_(ERROR, "cannot initialize XSync");
+		return;
 	}
-
-	return 0;
+	_FREE_(r);
+	sync_base	= ext->first_event;
+	using_xsync = true;
 }
 
-static int
-fullscreen_focus(xcb_window_t win)
+static void
+fill_icccm_ewmh(client_t *c, const window_props_t *p)
 {
-	uint32_t bpx_width = XCB_CW_BORDER_PIXEL;
-	uint32_t b_width   = XCB_CONFIG_WINDOW_BORDER_WIDTH;
-	uint32_t input	   = XCB_INPUT_FOCUS_PARENT;
-	uint32_t bcolor	   = 0;
-	uint32_t bwidth	   = 0;
-
-	/* if window is viewable before attempting focus */
-	if (!check_window_map_state(win, WIN_MAP_STATE_VIEWABLE)) {
-		return 0;
+	c->transient_for	 = p->transient_for;
+	c->override_redirect = p->override_redirect;
+	c->ewmh_type		 = p->ewmh_type;
+	c->ewmh_state		 = p->ewmh_state;
+	if (p->has_size_hints) {
+		c->size_hints = p->size_hints;
 	}
+	c->sync_counter = p->sync_counter;
+	setup_client_sync(c);
+	link_transient(c);
+	refresh_client_layer(c);
+}
 
-	if (change_window_attr(wm->connection, win, bpx_width, &bcolor) != 0) {
-		_LOG_(ERROR, "cannot update win attributes");
-		return -1;
-	}
+/* sends every request handle_map_request depends on before reading any reply.
+ * xcb keeps them in one write buffer, so the first reply costs a round trip
+ * and the rest are already queued by the time we ask for them */
+static void
+prefetch_window_props(xcb_window_t win, window_props_t *p)
+{
+	xcb_conn_t *conn = wm->connection;
+	*p				 = (window_props_t){0};
+	p->ewmh_type	 = WINDOW_TYPE_UNKNOWN;
+
+	xcb_get_window_attributes_cookie_t attr_c =
+		xcb_get_window_attributes(conn, win);
+	xcb_get_property_cookie_t class_c = xcb_icccm_get_wm_class(conn, win);
+	xcb_get_property_cookie_t type_c =
+		xcb_ewmh_get_wm_window_type(wm->ewmh, win);
+	xcb_get_property_cookie_t hints_c =
+		xcb_icccm_get_wm_normal_hints(conn, win);
+	xcb_get_property_cookie_t trans_c =
+		xcb_icccm_get_wm_transient_for(conn, win);
+	xcb_get_property_cookie_t state_c = xcb_ewmh_get_wm_state(wm->ewmh, win);
+	xcb_get_geometry_cookie_t geom_c  = xcb_get_geometry(conn, win);
+	xcb_query_pointer_cookie_t ptr_c =
+		xcb_query_pointer(conn, wm->root_window);
+	xcb_get_property_cookie_t proto_c =
+		xcb_icccm_get_wm_protocols(conn, win, wm->ewmh->WM_PROTOCOLS);
+	xcb_get_property_cookie_t sync_c =
+		xcb_get_property(conn,
+						 false,
+						 win,
+						 wm->ewmh->_NET_WM_SYNC_REQUEST_COUNTER,
+						 XCB_ATOM_CARDINAL,
+						 0,
+						 1);
 
-	if (configure_window(wm->connection, win, b_width, &bwidth) != 0) {
-		_LOG_(ERROR, "cannot configure window");
-		return -1;
+	xcb_get_window_attributes_reply_t *attr =
+		xcb_get_window_attributes_reply(conn, attr_c, NULL);
+	if (attr) {
+		p->override_redirect = attr->override_redirect;
+		_FREE_(attr);
 	}
 
-	if (set_input_focus(wm->connection, input, win, XCB_CURRENT_TIME) != 0) {
-		_LOG_(ERROR, "cannot set input focus");
-		return -1;
+	xcb_icccm_get_wm_class_reply_t wc;
+	if (xcb_icccm_get_wm_class_reply(conn, class_c, &wc, NULL) == 1) {
+		if (wc.class_name) {
+			snprintf(
+				p->class_name, sizeof(p->class_name), "%s", wc.class_name);
+		}
+		xcb_icccm_get_wm_class_reply_wipe(&wc);
 	}
 
-	raise_window(win);
+	xcb_ewmh_get_atoms_reply_t wt;
+	if (xcb_ewmh_get_wm_window_type_reply(wm->ewmh, type_c, &wt, NULL) == 1) {
+		p->ewmh_type = window_type_from_atoms(wt.atoms, wt.atoms_len);
+		xcb_ewmh_get_atoms_reply_wipe(&wt);
+	}
 
-	xcb_flush(wm->connection);
-	return 0;
-}
+	p->has_size_hints = xcb_icccm_get_wm_normal_hints_reply(
+							conn, hints_c, &p->size_hints, NULL) == 1;
 
-static int
-win_focus(xcb_window_t win, bool set_focus)
-{
-#ifdef _DEBUG__
-	char *name = win_name(win);
-	_LOG_(DEBUG,
-		  "[WIN_FOCUS] win=%d name='%s' set_focus=%s",
-		  win,
-		  name ? name : "(null)",
-		  set_focus ? "TRUE" : "FALSE");
-	_FREE_(name);
-#endif
-	uint32_t bpx_width = XCB_CW_BORDER_PIXEL;
-	uint32_t b_width   = XCB_CONFIG_WINDOW_BORDER_WIDTH;
-	uint32_t input	   = XCB_INPUT_FOCUS_PARENT;
-	uint32_t bcolor =
-		set_focus ? conf.active_border_color : conf.normal_border_color;
-	uint32_t bwidth = conf.border_width;
+	if (xcb_icccm_get_wm_transient_for_reply(
+			conn, trans_c, &p->transient_for, NULL) != 1) {
+		p->transient_for = XCB_NONE;
+	}
 
-	/* check if window is viewable before attempting focus operations */
-	if (set_focus) {
-		if (!check_window_map_state(win, WIN_MAP_STATE_VIEWABLE)) {
-			return 0;
-		}
+	xcb_ewmh_get_atoms_reply_t ws;
+	if (xcb_ewmh_get_wm_state_reply(wm->ewmh, state_c, &ws, NULL) == 1) {
+		p->ewmh_state = net_wm_state_from_atoms(ws.atoms, ws.atoms_len);
+		xcb_ewmh_get_atoms_reply_wipe(&ws);
 	}
 
-	if (change_window_attr(wm->connection, win, bpx_width, &bcolor) != 0) {
-		_LOG_(ERROR, "cannot update win attributes");
-		return -1;
+	xcb_get_geometry_reply_t *g = xcb_get_geometry_reply(conn, geom_c, NULL);
+	if (g) {
+		p->geometry		= (rectangle_t){.x		= g->x,
+										.y		= g->y,
+										.width	= g->width,
+										.height = g->height};
+		p->has_geometry = true;
+		_FREE_(g);
 	}
 
-	if (configure_window(wm->connection, win, b_width, &bwidth) != 0) {
-		_LOG_(ERROR, "cannot configure window");
-		return -1;
+	xcb_query_pointer_reply_t *ptr = xcb_query_pointer_reply(conn, ptr_c, NULL);
+	if (ptr) {
+		p->pointer_child = ptr->child;
+		p->pointer_x	 = ptr->root_x;
+		p->pointer_y	 = ptr->root_y;
+		p->has_pointer	 = true;
+		_FREE_(ptr);
 	}
 
-	if (set_focus) {
-		if (set_input_focus(wm->connection, input, win, XCB_CURRENT_TIME) !=
-			0) {
-			_LOG_(ERROR, "cannot set input focus");
-			return -1;
+	bool							   sync = false;
+	xcb_icccm_get_wm_protocols_reply_t pr;
+	if (xcb_icccm_get_wm_protocols_reply(conn, proto_c, &pr, NULL) == 1) {
+		for (uint32_t i = 0; i < pr.atoms_len; i++) {
+			if (pr.atoms[i] == wm->ewmh->_NET_WM_SYNC_REQUEST)
+				sync = true;
 		}
+		xcb_icccm_get_wm_protocols_reply_wipe(&pr);
+	}
+	xcb_get_property_reply_t *sc = xcb_get_property_reply(conn, sync_c, NULL);
+	if (sc) {
+		if (sync && sc->format == 32 && xcb_get_property_value_length(sc) >= 4)
+			p->sync_counter =
+				*(xcb_sync_counter_t *)xcb_get_property_value(sc);
+		_FREE_(sc);
 	}
-
-	xcb_flush(wm->connection);
-	return 0;
 }
 
-/* TODO: rewrite this */
-static int
-change_border_attr(xcb_conn_t  *conn,
-				   xcb_window_t win,
-				   uint32_t		bcolor,
-				   uint32_t		bwidth,
-				   bool			stack)
+static const char *
+xreq_op_to_string(xreq_op_t op)
 {
+	switch (op) {
+	case XREQ_RESIZE: return "resize";
+	case XREQ_MOVE: return "move";
+	case XREQ_GEOMETRY: return "configure geometry";
+	case XREQ_CONFIGURE: return "configure";
+	case XREQ_MAP: return "map";
+	case XREQ_CHANGE_ATTR: return "change attributes";
+	case XREQ_EVENT_MASK: return "select input";
+	case XREQ_INPUT_FOCUS: return "set input focus";
+	case XREQ_STACK: return "restack";
+	case XREQ_UNMAP: return "unmap";
+	case XREQ_PROPERTY: return "change property";
+	case XREQ_SYNC: return "sync alarm";
+	case XREQ_GRAB_KEY: return "grab key";
+	case XREQ_UNGRAB_KEY: return "ungrab key";
+	case XREQ_GRAB_BUTTON: return "grab button";
+	case XREQ_UNGRAB_BTN: return "ungrab button";
+	case XREQ_NONE: break;
+	}
+	return "unknown";
+}
 
-	uint32_t bpx_width = XCB_CW_BORDER_PIXEL;
-	uint32_t b_width   = XCB_CONFIG_WINDOW_BORDER_WIDTH;
-	uint32_t stack_	   = XCB_CONFIG_WINDOW_STACK_MODE;
-	uint32_t input	   = XCB_INPUT_FOCUS_PARENT;
+/* track_request - remembers who owns an unchecked request.
+ *
+ * hot paths send their requests unchecked and never wait on a reply. if the
+ * server rejects one, the error arrives through the event queue with the
+ * request's sequence number, which is used to find the owning window and
+ * operation in handle_x_error. Older entries are simply overwritten once the
+ * ring wraps around. */
+void
+track_request(xcb_cookie_t cookie, xcb_window_t win, xreq_op_t op)
+{
+	xreq_t *r	= &xreq_ring[cookie.sequence & (XREQ_RING_SIZE - 1)];
+	r->sequence = cookie.sequence;
+	r->window	= win;
+	r->op		= op;
+}
 
-	if (change_window_attr(conn, win, bpx_width, &bcolor) != 0) {
-		return -1;
+/* handle_x_error - harvests an asynchronous error from the event loop and
+ * routes it back to the request that caused it.
+ *
+ * BadWindow on a managed client means the window was destroyed before the
+ * server got to our request, so the client is dropped right away instead of
+ * waiting for its DestroyNotify. Everything else is logged. */
+static void
+handle_x_error(const xcb_error_t *err)
+{
+	const xreq_t *r = &xreq_ring[err->full_sequence & (XREQ_RING_SIZE - 1)];
+	if (r->op == XREQ_NONE || r->sequence != err->full_sequence) {
+#ifdef _DEBUG__
+		_LOG_(DEBUG,
+			  "x error %d on untracked request %#x (major %d, sequence %u)",
+			  err->error_code,
+			  err->resource_id,
+			  err->major_code,
+			  err->full_sequence);
+#endif
+		return;
 	}
 
-	if (configure_window(conn, win, b_width, &bwidth) != 0) {
-		return -1;
+	_LOG_(ERROR,
+		  "%s failed for window %d: error code %d",
+		  xreq_op_to_string(r->op),
+		  r->window,
+		  err->error_code);
+
+	if (err->error_code == XCB_WINDOW && find_node_global(r->window)) {
+		kill_window(r->window);
 	}
+}
 
-	if (stack) {
-		const uint16_t arg[1] = {XCB_STACK_MODE_ABOVE};
-		if (configure_window(conn, win, stack_, arg) != 0) {
+int
+resize_window(xcb_window_t win, uint16_t width, uint16_t height)
+{
+	if (win == 0 || win == XCB_NONE)
+		return 0;
+
+	const uint32_t values[] = {width, height};
+	xcb_cookie_t   cookie =
+		xcb_configure_window(wm->connection, win, RESIZE, values);
+	track_request(cookie, win, XREQ_RESIZE);
+
+	return 0;
+}
+
+int
+move_window(xcb_window_t win, int16_t x, int16_t y)
+{
+	if (win == 0 || win == XCB_NONE) {
+		return 0;
+	}
+
+	const uint32_t values[] = {x, y};
+	xcb_cookie_t   cookie =
+		xcb_configure_window(wm->connection, win, MOVE, values);
+	track_request(cookie, win, XREQ_MOVE);
+
+	return 0;
+}
+
+/* configure_geometry - commits position, size and border width in a single
+ * ConfigureWindow, so the client gets one ConfigureNotify and relayouts once
+ * instead of once for the resize and again for the move */
+int
+configure_geometry(xcb_window_t win, rectangle_t r, uint16_t border_width)
+{
+	if (win == 0 || win == XCB_NONE) {
+		return 0;
+	}
+
+	/* value order follows the mask bits: x, y, width, height, border */
+	const uint32_t values[] = {
+		(uint32_t)r.x, (uint32_t)r.y, r.width, r.height, border_width};
+	xcb_cookie_t cookie =
+		xcb_configure_window(wm->connection, win, GEOMETRY, values);
+	track_request(cookie, win, XREQ_GEOMETRY);
+
+	return 0;
+}
+
+/* commit_client_geometry - configure_geometry for managed clients.
+ * The request is skipped when the client's shadow says the server already
+ * has this exact geometry and border width, so re-rendering a tree only
+ * touches the windows that actually moved or changed size */
+int
+commit_client_geometry(client_t *c, rectangle_t r, uint16_t border_width)
+{
+	shadow_t *s = &c->shadow;
+	if (s->rect_valid && s->border_valid && s->border_width == border_width &&
+		RECT_EQ(s->rect, r)) {
+		return 0;
+	}
+
+	/* only a configure that resizes gets painted and acked, a move or a
+	 * skipped configure would leave the client owing an ack */
+	if (s->rect_valid &&
+		(s->rect.width != r.width || s->rect.height != r.height))
+		send_sync_request(c);
+
+	if (configure_geometry(c->window, r, border_width) != 0) {
+		return -1;
+	}
+
+	s->rect			= r;
+	s->border_width = border_width;
+	s->rect_valid	= true;
+	s->border_valid = true;
+	shadow_writes++;
+	return 0;
+}
+
+/* commit_client_map - maps a client unless it is already mapped */
+int
+commit_client_map(client_t *c)
+{
+	if (c->shadow.mapped) {
+		return 0;
+	}
+
+	xcb_cookie_t cookie = xcb_map_window(wm->connection, c->window);
+	track_request(cookie, c->window, XREQ_MAP);
+	c->shadow.mapped = true;
+	shadow_writes++;
+	return 0;
+}
+
+/* commit_client_border - sets border color and width, skipping whichever of
+ * the two the server already has */
+static int
+commit_client_border(client_t *c, uint32_t color, uint16_t width)
+{
+	shadow_t *s = &c->shadow;
+
+	if (!s->color_valid || s->border_color != color) {
+		if (change_window_attr(
+				wm->connection, c->window, XCB_CW_BORDER_PIXEL, &color) != 0) {
 			return -1;
 		}
+		s->border_color = color;
+		s->color_valid	= true;
+	}
 
-		if (set_input_focus(conn, input, win, XCB_CURRENT_TIME) != 0) {
+	if (!s->border_valid || s->border_width != width) {
+		const uint32_t bwidth = width;
+		if (configure_window(
+				wm->connection, c->window, WINDOW_BORDER, &bwidth) != 0) {
+			return -1;
+		}
+		s->border_width = width;
+		s->border_valid = true;
+		shadow_writes++;
+	}
+
+	return 0;
+}
+
+static int
+fullscreen_focus(client_t *c)
+{
+	xcb_window_t win   = c->window;
+	uint32_t	 input = XCB_INPUT_FOCUS_PARENT;
+
+	/* the shadow knows whether it is mapped, no round trip on focus */
+	if (!c->shadow.mapped) {
+		return 0;
+	}
+
+	if (commit_client_border(c, 0, 0) != 0) {
+		_LOG_(ERROR, "cannot update window border");
+		return -1;
+	}
+
+	if (set_input_focus(wm->connection, input, win, XCB_CURRENT_TIME) != 0) {
+		_LOG_(ERROR, "cannot set input focus");
+		return -1;
+	}
+
+	raise_window(win);
+
+	return 0;
+}
+
+static int
+win_focus(client_t *c, bool set_focus)
+{
+	xcb_window_t win = c->window;
+#ifdef _DEBUG__
+	char *name = win_name(win);
+	_LOG_(DEBUG,
+		  "[WIN_FOCUS] win=%d name='%s' set_focus=%s",
+		  win,
+		  name ? name : "(null)",
+		  set_focus ? "TRUE" : "FALSE");
+	_FREE_(name);
+#endif
+	uint32_t input = XCB_INPUT_FOCUS_PARENT;
+	uint32_t bcolor =
+		set_focus ? conf.active_border_color : conf.normal_border_color;
+
+	/* focusing an unmapped window is a BadMatch. clients are children of
+	 * the root, so mapped is viewable */
+	if (set_focus && !c->shadow.mapped) {
+		return 0;
+	}
+
+	if (commit_client_border(c, bcolor, conf.border_width) != 0) {
+		_LOG_(ERROR, "cannot update window border");
+		return -1;
+	}
+
+	if (set_focus) {
+		if (set_input_focus(wm->connection, input, win, XCB_CURRENT_TIME) !=
+			0) {
+			_LOG_(ERROR, "cannot set input focus");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* TODO: rewrite this */
+static int
+change_border_attr(client_t *c, uint32_t bcolor, uint32_t bwidth, bool stack)
+{
+	xcb_conn_t	*conn  = wm->connection;
+	xcb_window_t win   = c->window;
+	uint32_t	 input = XCB_INPUT_FOCUS_PARENT;
+
+	if (commit_client_border(c, bcolor, (uint16_t)bwidth) != 0) {
+		return -1;
+	}
+
+	if (stack) {
+		raise_window(win);
+
+		/* a _NET_WM_STATE request can take a window on a hidden desktop out
+		 * of fullscreen, focusing it while unmapped is a BadMatch */
+		if (c->shadow.mapped &&
+			set_input_focus(conn, input, win, XCB_CURRENT_TIME) != 0) {
 			return -1;
 		}
 	}
 
-	xcb_flush(conn);
 	return 0;
 }
 
@@ -3696,15 +4196,8 @@ change_window_attr(xcb_conn_t  *conn,
 				   const void  *val)
 {
 	xcb_cookie_t attr_cookie =
-		xcb_change_window_attributes_checked(conn, win, attr, val);
-	xcb_error_t *err = xcb_request_check(conn, attr_cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "failed to change window attributes: error code %d",
-			  err->error_code);
-		_FREE_(err);
-		return -1;
-	}
+		xcb_change_window_attributes(conn, win, attr, val);
+	track_request(attr_cookie, win, XREQ_CHANGE_ATTR);
 	return 0;
 }
 
@@ -3714,16 +4207,8 @@ configure_window(xcb_conn_t	 *conn,
 				 uint16_t	  attr,
 				 const void	 *val)
 {
-	xcb_cookie_t config_cookie =
-		xcb_configure_window_checked(conn, win, attr, val);
-	xcb_error_t *err = xcb_request_check(conn, config_cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "failed to configure window : error code %d",
-			  err->error_code);
-		_FREE_(err);
-		return -1;
-	}
+	xcb_cookie_t config_cookie = xcb_configure_window(conn, win, attr, val);
+	track_request(config_cookie, win, XREQ_CONFIGURE);
 	return 0;
 }
 
@@ -3733,27 +4218,11 @@ set_input_focus(xcb_conn_t	   *conn,
 				xcb_window_t	win,
 				xcb_timestamp_t time)
 {
-	/* if window is viewable before attempting to set focus */
-	if (!check_window_map_state(win, WIN_MAP_STATE_VIEWABLE)) {
-		return -1;
-	}
-
+	/* callers check viewability before focusing. if the window got unmapped
+	 * in the meantime, the BadMatch shows up later in handle_x_error */
 	xcb_cookie_t focus_cookie =
-		xcb_set_input_focus_checked(conn, revert_to, win, time);
-	xcb_error_t *err = xcb_request_check(conn, focus_cookie);
-	if (err) {
-		char *n = win_name(win);
-		_LOG_(ERROR,
-			  "failed to set input focus for win %d name %s : error code %d "
-			  "error message %s",
-			  win,
-			  n,
-			  err->error_code,
-			  strerror(err->error_code));
-		_FREE_(err);
-		_FREE_(n);
-		return -1;
-	}
+		xcb_set_input_focus(conn, revert_to, win, time);
+	track_request(focus_cookie, win, XREQ_INPUT_FOCUS);
 	return 0;
 }
 
@@ -3766,35 +4235,14 @@ tile(node_t *node)
 		return -1;
 	}
 
-	const uint16_t width  = IS_FLOATING(node->client)
-								? node->floating_rectangle.width
-								: node->rectangle.width;
-	const uint16_t height = IS_FLOATING(node->client)
-								? node->floating_rectangle.height
-								: node->rectangle.height;
-	const int16_t  x = IS_FLOATING(node->client) ? node->floating_rectangle.x
-												 : node->rectangle.x;
-	const int16_t  y = IS_FLOATING(node->client) ? node->floating_rectangle.y
-												 : node->rectangle.y;
+	const rectangle_t r = IS_FLOATING(node->client) ? node->floating_rectangle
+													: node->rectangle;
 
-	if (resize_window(node->client->window, width, height) != 0 ||
-		move_window(node->client->window, x, y) != 0) {
-		return -1;
-	}
-
-	xcb_cookie_t cookie =
-		xcb_map_window_checked(wm->connection, node->client->window);
-	xcb_error_t *err = xcb_request_check(wm->connection, cookie);
-	if (err) {
-		_LOG_(ERROR,
-			  "in mapping window %d: error code %d",
-			  node->client->window,
-			  err->error_code);
-		_FREE_(err);
+	if (commit_client_geometry(node->client, r, conf.border_width) != 0 ||
+		commit_client_map(node->client) != 0) {
 		return -1;
 	}
 
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -3825,12 +4273,7 @@ supports_protocol(xcb_window_t win, xcb_atom_t atom, xcb_conn_t *conn)
 static int
 display_client(rectangle_t r, xcb_window_t win)
 {
-	uint16_t width	= r.width;
-	uint16_t height = r.height;
-	int16_t	 x		= r.x;
-	int16_t	 y		= r.y;
-
-	if (resize_window(win, width, height) != 0 || move_window(win, x, y) != 0) {
+	if (configure_geometry(win, r, conf.border_width) != 0) {
 		return -1;
 	}
 
@@ -3843,7 +4286,6 @@ display_client(rectangle_t r, xcb_window_t win)
 		return -1;
 	}
 
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -3883,35 +4325,113 @@ get_window_under_cursor(xcb_conn_t *conn, xcb_window_t win)
 	return x;
 }
 
+/* fetches the keysyms of count keycodes from first into the keymap. the
+ * whole map is fetched again if the server's keysyms per keycode moved */
+static bool
+fetch_keymap(xcb_conn_t *conn, xcb_keycode_t first, uint16_t count)
+{
+	xcb_get_keyboard_mapping_reply_t *r = xcb_get_keyboard_mapping_reply(
+		conn, xcb_get_keyboard_mapping(conn, first, (uint8_t)count), NULL);
+	if (r == NULL) {
+		return false;
+	}
+
+	const xcb_keysym_t *syms = xcb_get_keyboard_mapping_keysyms(r);
+	const int			len	 = xcb_get_keyboard_mapping_keysyms_length(r);
+	if (keymap.syms == NULL || r->keysyms_per_keycode != keymap.per) {
+		if (first != keymap.min || count != keymap.max - keymap.min + 1) {
+			_FREE_(r);
+			_FREE_(keymap.syms);
+			return fetch_keymap(conn, keymap.min, keymap.max - keymap.min + 1);
+		}
+		xcb_keysym_t *s = realloc(keymap.syms, (size_t)len * sizeof(*s));
+		if (s == NULL) {
+			_FREE_(r);
+			return false;
+		}
+		keymap.syms = s;
+		keymap.per	= r->keysyms_per_keycode;
+	}
+	if ((size_t)len == (size_t)count * keymap.per) {
+		memcpy(&keymap.syms[(first - keymap.min) * keymap.per],
+			   syms,
+			   (size_t)len * sizeof(*syms));
+	}
+	_FREE_(r);
+	return true;
+}
+
+/* the keyboard mapping is fetched once, the first time it is needed, and
+ * then only patched by handle_mapping_notify() */
+static keymap_t *
+get_keymap(xcb_conn_t *conn)
+{
+	if (keymap.syms == NULL) {
+		const xcb_setup_t *setup = xcb_get_setup(conn);
+		keymap.min				 = setup->min_keycode;
+		keymap.max				 = setup->max_keycode;
+		keymap.per				 = 0;
+		if (!fetch_keymap(conn, keymap.min, keymap.max - keymap.min + 1)) {
+			_LOG_(ERROR, "cannot fetch the keyboard mapping");
+			return NULL;
+		}
+	}
+	return &keymap;
+}
+
+/* the keysym in the first column of keycode. as in xcb-util-keysyms it is
+ * lowercased when the keycode has no second column, for latin-1 only */
+static xcb_keysym_t
+keymap_keysym(const keymap_t *km, xcb_keycode_t keycode)
+{
+	if (keycode < km->min || keycode > km->max || km->per == 0) {
+		return XCB_NO_SYMBOL;
+	}
+	const xcb_keysym_t *s = &km->syms[(keycode - km->min) * km->per];
+	xcb_keysym_t		k = s[0];
+	if ((km->per < 2 || s[1] == XCB_NO_SYMBOL) &&
+		((k >= XK_A && k <= XK_Z) ||
+		 (k >= XK_Agrave && k <= XK_THORN && k != XK_multiply))) {
+		k += XK_a - XK_A;
+	}
+	return k;
+}
+
+/* every keycode with keysym in one of its columns, XCB_NO_SYMBOL terminated
+ * and owned by the caller */
 static xcb_keycode_t *
 get_keycode(xcb_keysym_t keysym, xcb_conn_t *conn)
 {
-	xcb_key_symbols_t *keysyms = NULL;
-	xcb_keycode_t	  *keycode = NULL;
+	keymap_t *km = get_keymap(conn);
+	if (km == NULL)
+		return NULL;
 
-	if ((keysyms = xcb_key_symbols_alloc(conn)) == NULL) {
-		xcb_key_symbols_free(keysyms);
+	const size_t   n   = (size_t)(km->max - km->min) + 1;
+	xcb_keycode_t *out = malloc((n + 1) * sizeof(*out));
+	if (out == NULL)
 		return NULL;
+	size_t len = 0;
+	for (size_t i = 0; i < n; i++) {
+		const xcb_keycode_t kc = (xcb_keycode_t)(km->min + i);
+		const xcb_keysym_t *s  = &km->syms[i * km->per];
+		bool				hit = keymap_keysym(km, kc) == keysym;
+		for (uint8_t j = 0; !hit && j < km->per; j++)
+			hit = (s[j] == keysym);
+		if (hit)
+			out[len++] = kc;
 	}
-
-	keycode = xcb_key_symbols_get_keycode(keysyms, keysym);
-	xcb_key_symbols_free(keysyms);
-
-	return keycode;
+	out[len] = XCB_NO_SYMBOL;
+	return out;
 }
 
 static xcb_keysym_t
 get_keysym(xcb_keycode_t keycode, xcb_connection_t *conn)
 {
-	xcb_key_symbols_t *keysyms = xcb_key_symbols_alloc(conn);
-	xcb_keysym_t	   keysym  = 0;
-
-	if (keysyms) {
-		keysym = xcb_key_symbols_get_keysym(keysyms, keycode, 0);
-		xcb_key_symbols_free(keysyms);
-	}
+	keymap_t *km = get_keymap(conn);
+	if (km == NULL)
+		return 0;
 
-	return keysym;
+	return keymap_keysym(km, keycode);
 }
 
 void
@@ -4028,15 +4548,15 @@ clear_mouse_state(void)
 	mouse_state = (mouse_state_t){0};
 }
 
-static double
-clamp_ratio(double ratio)
+static ratio_t
+clamp_ratio(ratio_t ratio)
 {
-	const double min = 0.05;
+	const ratio_t min = RATIO_ONE / 20;
 	if (ratio < min) {
 		return min;
 	}
-	if (ratio > (1.0 - min)) {
-		return 1.0 - min;
+	if (ratio > (RATIO_ONE - min)) {
+		return RATIO_ONE - min;
 	}
 	return ratio;
 }
@@ -4044,25 +4564,20 @@ clamp_ratio(double ratio)
 static uint8_t
 detect_resize_edges(rectangle_t r, int16_t x, int16_t y)
 {
-	const int16_t edge	   = 10;
-	uint8_t		  edges	   = 0;
+	const int32_t edge	   = 10;
 	int16_t		  left_d   = (int16_t)(x - r.x);
 	int16_t		  right_d  = (int16_t)((r.x + (int16_t)r.width) - x);
 	int16_t		  top_d	   = (int16_t)(y - r.y);
 	int16_t		  bottom_d = (int16_t)((r.y + (int16_t)r.height) - y);
 
-	if (left_d >= 0 && left_d <= edge) {
-		edges |= RESIZE_EDGE_LEFT;
-	}
-	if (right_d >= 0 && right_d <= edge) {
-		edges |= RESIZE_EDGE_RIGHT;
-	}
-	if (top_d >= 0 && top_d <= edge) {
-		edges |= RESIZE_EDGE_TOP;
-	}
-	if (bottom_d >= 0 && bottom_d <= edge) {
-		edges |= RESIZE_EDGE_BOTTOM;
-	}
+	/* the four strips edge + 1 px wide along the inside of each side, in
+	 * RESIZE_EDGE_* bit order, tested in one pass */
+	int32_t	   sx[4]  = {r.x, r.x + r.width - edge, INT16_MIN, INT16_MIN};
+	int32_t	   sy[4]  = {INT16_MIN, INT16_MIN, r.y, r.y + r.height - edge};
+	int32_t	   sw[4]  = {edge + 1, edge + 1, SPAN_ALL, SPAN_ALL};
+	int32_t	   sh[4]  = {SPAN_ALL, SPAN_ALL, edge + 1, edge + 1};
+	rect_soa_t strips = {sx, sy, sw, sh, 4, 4};
+	uint8_t	   edges  = (uint8_t)rect_soa_hits(&strips, x, y, 0);
 
 	if ((edges & (RESIZE_EDGE_LEFT | RESIZE_EDGE_RIGHT)) ==
 		(RESIZE_EDGE_LEFT | RESIZE_EDGE_RIGHT)) {
@@ -4086,7 +4601,8 @@ is_resize_band_hit(node_t	   *parent,
 		return false;
 	}
 
-	const int16_t edge = 8;
+	/* the gap between the children, grown by RESIZE_BAND when tested */
+	int32_t bx = INT16_MIN, by = INT16_MIN, bw = SPAN_ALL, bh = SPAN_ALL;
 	if (split_type == HORIZONTAL_TYPE) {
 		rectangle_t a	   = parent->first_child->rectangle;
 		rectangle_t b	   = parent->second_child->rectangle;
@@ -4095,9 +4611,9 @@ is_resize_band_hit(node_t	   *parent,
 		int16_t right_edge = (int16_t)(a_left ? b.x : a.x);
 		int16_t min_x	   = (left_edge < right_edge) ? left_edge : right_edge;
 		int16_t max_x	   = (left_edge > right_edge) ? left_edge : right_edge;
-		return (x >= (min_x - edge) && x <= (max_x + edge));
-	}
-	if (split_type == VERTICAL_TYPE) {
+		bx				   = min_x;
+		bw				   = max_x - min_x + 1;
+	} else if (split_type == VERTICAL_TYPE) {
 		rectangle_t a	  = parent->first_child->rectangle;
 		rectangle_t b	  = parent->second_child->rectangle;
 		bool		a_top = (a.y <= b.y);
@@ -4105,64 +4621,99 @@ is_resize_band_hit(node_t	   *parent,
 		int16_t bottom_edge = (int16_t)(a_top ? b.y : a.y);
 		int16_t min_y		= (top_edge < bottom_edge) ? top_edge : bottom_edge;
 		int16_t max_y		= (top_edge > bottom_edge) ? top_edge : bottom_edge;
-		return (y >= (min_y - edge) && y <= (max_y + edge));
+		by					= min_y;
+		bh					= max_y - min_y + 1;
+	} else {
+		return false;
 	}
 
-	return false;
+	rect_soa_t band = {&bx, &by, &bw, &bh, 1, 1};
+	return rect_soa_hit(&band, 0, x, y, RESIZE_BAND) == 0;
 }
 
-static void
-grab_super_button(xcb_window_t win, uint8_t button)
-{
-	const uint16_t numlock = (uint16_t)modfield_from_keysym(XK_Num_Lock);
-	const uint16_t caps	   = XCB_MOD_MASK_LOCK;
-	const uint16_t mods[]  = {
-		 SUPER,
-		 (uint16_t)(SUPER | caps),
-		 (uint16_t)(SUPER | numlock),
-		 (uint16_t)(SUPER | numlock | caps),
-	 };
-	bool logged = false;
-
-	for (size_t i = 0; i < sizeof(mods) / sizeof(mods[0]); i++) {
-		uint16_t mod = mods[i];
-		bool	 dup = false;
-		for (size_t j = 0; j < i; j++) {
-			if (mods[j] == mod) {
-				dup = true;
-				break;
-			}
-		}
-		if (dup) {
-			continue;
-		}
+/* the modifier NumLock sits on. asking costs a round trip, so it is only
+ * asked again after the modifier mapping may have changed */
+static uint16_t numlock_mod	  = 0;
+static bool		numlock_known = false;
 
-		xcb_void_cookie_t c = xcb_grab_button_checked(
-			wm->connection,
-			0,	 /* owner_events */
-			win, /* grab_window */
-			XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE |
-				XCB_EVENT_MASK_POINTER_MOTION,
-			XCB_GRAB_MODE_ASYNC, /* allow processing */
-			XCB_GRAB_MODE_ASYNC, /* keyboard_mode */
-			XCB_NONE,			 /* confine_to */
-			XCB_NONE,			 /* cursor */
-			button,				 /* button */
-			mod);				 /* modifiers */
-
-		xcb_generic_error_t *err = xcb_request_check(wm->connection, c);
-		if (err) {
-			_LOG_(ERROR,
-				  "could not grab SUPER+Button%d on root (mod=0x%x): %d",
-				  button,
-				  mod,
-				  err->error_code);
-			_FREE_(err);
-		} else if (!logged) {
-			_LOG_(INFO, "grabbed SUPER+Button%d on root", button);
-			logged = true;
+static uint16_t
+numlock_modifier(void)
+{
+	if (!numlock_known) {
+		numlock_mod	  = (uint16_t)modfield_from_keysym(XK_Num_Lock);
+		numlock_known = true;
+	}
+	return numlock_mod;
+}
+
+/* SUPER+Button1/3 with and without the lock modifiers */
+static size_t
+super_button_mods(uint16_t numlock, uint16_t *mods)
+{
+	const uint16_t caps = XCB_MOD_MASK_LOCK;
+	size_t		   n	= 0;
+	mods[n++]			= SUPER;
+	mods[n++]			= (uint16_t)(SUPER | caps);
+	if (numlock != 0 && numlock != caps) {
+		mods[n++] = (uint16_t)(SUPER | numlock);
+		mods[n++] = (uint16_t)(SUPER | numlock | caps);
+	}
+	return n;
+}
+
+/* grab_super_buttons - grabs SUPER+Button1/3 on win, unchecked and tracked.
+ * once grabbed, only a NumLock move sends anything: the variants for the
+ * old NumLock are ungrabbed and the ones for the new one grabbed. returns
+ * the number of requests sent, the caller syncs once for all of them */
+static size_t
+grab_super_buttons(xcb_conn_t *conn, xcb_window_t win)
+{
+	static bool		grabbed			= false;
+	static uint16_t grabbed_numlock = 0;
+
+	const uint16_t numlock = numlock_modifier();
+	if (grabbed && numlock == grabbed_numlock) {
+		return 0;
+	}
+
+	const uint8_t buttons[] = {XCB_BUTTON_INDEX_1, XCB_BUTTON_INDEX_3};
+	uint16_t	  old[4], mods[4];
+	size_t		  n_old = 0, sent = 0;
+	size_t		  n		= super_button_mods(numlock, mods);
+	size_t		  first = 0;
+	if (grabbed) {
+		/* the plain SUPER variants stay grabbed */
+		n_old = super_button_mods(grabbed_numlock, old);
+		first = 2;
+	}
+
+	for (size_t b = 0; b < LEN(buttons); b++) {
+		for (size_t i = 2; i < n_old; i++) {
+			xcb_cookie_t c = xcb_ungrab_button(conn, buttons[b], win, old[i]);
+			track_request(c, win, XREQ_UNGRAB_BTN);
+			sent++;
+		}
+		for (size_t i = first; i < n; i++) {
+			xcb_cookie_t c = xcb_grab_button(
+				conn,
+				0,	 /* owner_events */
+				win, /* grab_window */
+				XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE |
+					XCB_EVENT_MASK_POINTER_MOTION,
+				XCB_GRAB_MODE_ASYNC, /* allow processing */
+				XCB_GRAB_MODE_ASYNC, /* keyboard_mode */
+				XCB_NONE,			 /* confine_to */
+				XCB_NONE,			 /* cursor */
+				buttons[b],			 /* button */
+				mods[i]);			 /* modifiers */
+			track_request(c, win, XREQ_GRAB_BUTTON);
+			sent++;
 		}
 	}
+
+	grabbed			= true;
+	grabbed_numlock = numlock;
+	return sent;
 }
 
 static bool
@@ -4181,9 +4732,7 @@ start_floating_move(node_t *n, int16_t x, int16_t y)
 	mouse_state.start_rect = n->floating_rectangle;
 	mouse_state.edges	   = 0;
 
-	const uint32_t val[]   = {XCB_STACK_MODE_ABOVE};
-	xcb_configure_window(
-		wm->connection, n->client->window, XCB_CONFIG_WINDOW_STACK_MODE, val);
+	raise_window(n->client->window);
 
 	if (!grab_pointer_for_mouse(CURSOR_MOVE)) {
 		clear_mouse_state();
@@ -4214,9 +4763,7 @@ start_floating_resize(node_t *n, int16_t x, int16_t y)
 	mouse_state.start_rect = n->floating_rectangle;
 	mouse_state.edges	   = edges;
 
-	const uint32_t val[]   = {XCB_STACK_MODE_ABOVE};
-	xcb_configure_window(
-		wm->connection, n->client->window, XCB_CONFIG_WINDOW_STACK_MODE, val);
+	raise_window(n->client->window);
 
 	if (!grab_pointer_for_mouse(CURSOR_MOVE)) {
 		clear_mouse_state();
@@ -4264,7 +4811,7 @@ start_tiled_resize(node_t *n, int16_t x, int16_t y)
 	const int16_t first_size = (st == HORIZONTAL_TYPE)
 								   ? p->first_child->rectangle.width
 								   : p->first_child->rectangle.height;
-	const double  ratio		 = (double)first_size / (double)avail;
+	const ratio_t ratio		 = RATIO_OF(first_size, avail);
 
 	mouse_state.op			 = MOUSE_OP_RESIZE_TILED;
 	mouse_state.node		 = n;
@@ -4295,7 +4842,11 @@ handle_mouse_motion(int16_t x, int16_t y)
 		r.x			   = (int16_t)(r.x + dx);
 		r.y			   = (int16_t)(r.y + dy);
 		mouse_state.node->floating_rectangle = r;
-		move_window(mouse_state.window, r.x, r.y);
+		if (conf.outline_mode)
+			outline_show(r);
+		else
+			commit_client_geometry(
+				mouse_state.node->client, r, conf.border_width);
 		return;
 	}
 
@@ -4344,9 +4895,13 @@ handle_mouse_motion(int16_t x, int16_t y)
 			.width	= (uint16_t)nw,
 			.height = (uint16_t)nh,
 		};
+		if (conf.outline_mode) {
+			mouse_state.node->floating_rectangle = r;
+			outline_show(r);
+			return;
+		}
 		mouse_state.node->floating_rectangle = r;
-		resize_window(mouse_state.window, r.width, r.height);
-		move_window(mouse_state.window, r.x, r.y);
+		commit_client_geometry(mouse_state.node->client, r, conf.border_width);
 		return;
 	}
 
@@ -4370,50 +4925,241 @@ handle_mouse_motion(int16_t x, int16_t y)
 			new_first = mouse_state.avail - min_size;
 		}
 
-		double ratio = (double)new_first / (double)mouse_state.avail;
+		ratio_t ratio = clamp_ratio(RATIO_OF(new_first, mouse_state.avail));
+		if (mouse_state.parent->split_type == mouse_state.split_type &&
+			mouse_state.parent->split_ratio == ratio)
+			return;
 		mouse_state.parent->split_type	= mouse_state.split_type;
-		mouse_state.parent->split_ratio = clamp_ratio(ratio);
+		mouse_state.parent->split_ratio = ratio;
 		resize_subtree(mouse_state.parent);
+		if (conf.outline_mode) {
+			/* only the node rects move, the clients follow on release */
+			outline_show_split(mouse_state.parent->first_child->rectangle,
+							   mouse_state.parent->second_child->rectangle);
+			return;
+		}
 		render_tree_nomap(mouse_state.parent);
 		return;
 	}
 }
 
-static void
-finish_mouse_action(void)
+/* refresh interval of the monitor's current randr mode, cached on the
+ * monitor until the next randr change */
+static uint32_t
+monitor_frame_us(monitor_t *m)
 {
-	ungrab_pointer();
-	clear_mouse_state();
-	xcb_flush(wm->connection);
-}
+	if (m == NULL || !using_xrandr)
+		return FRAME_US_DEFAULT;
+	if (m->frame_us)
+		return m->frame_us;
 
-static void
-cancel_mouse_action(void)
-{
-	if (mouse_state.op == MOUSE_OP_MOVE_FLOATING ||
-		mouse_state.op == MOUSE_OP_RESIZE_FLOATING) {
-		if (mouse_state.node && mouse_state.node->client) {
-			mouse_state.node->floating_rectangle = mouse_state.start_rect;
-			resize_window(mouse_state.window,
-						  mouse_state.start_rect.width,
-						  mouse_state.start_rect.height);
-			move_window(mouse_state.window,
-						mouse_state.start_rect.x,
-						mouse_state.start_rect.y);
-		}
-	} else if (mouse_state.op == MOUSE_OP_RESIZE_TILED) {
-		if (mouse_state.parent) {
-			mouse_state.parent->split_type	= mouse_state.split_type;
-			mouse_state.parent->split_ratio = mouse_state.start_ratio;
+	m->frame_us		 = FRAME_US_DEFAULT;
+	xcb_conn_t *conn = wm->connection;
+	xcb_randr_get_output_info_cookie_t oc =
+		xcb_randr_get_output_info(conn, m->randr_id, XCB_CURRENT_TIME);
+	xcb_randr_get_screen_resources_current_cookie_t sc =
+		xcb_randr_get_screen_resources_current(conn, wm->root_window);
+	xcb_randr_get_output_info_reply_t *info =
+		xcb_randr_get_output_info_reply(conn, oc, NULL);
+	xcb_randr_get_screen_resources_current_reply_t *sr =
+		xcb_randr_get_screen_resources_current_reply(conn, sc, NULL);
+	xcb_randr_get_crtc_info_reply_t *crtc = NULL;
+	if (info == NULL || sr == NULL || info->crtc == XCB_NONE)
+		goto out;
+
+	crtc = xcb_randr_get_crtc_info_reply(
+		conn,
+		xcb_randr_get_crtc_info(conn, info->crtc, XCB_CURRENT_TIME),
+		NULL);
+	if (crtc == NULL)
+		goto out;
+
+	const xcb_randr_mode_info_t *modes =
+		xcb_randr_get_screen_resources_current_modes(sr);
+	const int n = xcb_randr_get_screen_resources_current_modes_length(sr);
+	for (int i = 0; i < n; i++) {
+		const xcb_randr_mode_info_t *mi = &modes[i];
+		if (mi->id != crtc->mode)
+			continue;
+		uint64_t vtotal = mi->vtotal;
+		if (mi->mode_flags & XCB_RANDR_MODE_FLAG_DOUBLE_SCAN)
+			vtotal *= 2;
+		if (mi->mode_flags & XCB_RANDR_MODE_FLAG_INTERLACE)
+			vtotal /= 2;
+		if (mi->dot_clock && mi->htotal && vtotal) {
+			uint64_t us = (uint64_t)mi->htotal * vtotal * 1000000 /
+						  mi->dot_clock;
+			/* 500Hz to 20Hz, anything outside is a bogus mode line */
+			if (us >= 2000 && us <= 50000)
+				m->frame_us = (uint32_t)us;
+		}
+		break;
+	}
+	_LOG_(INFO, "monitor %s frame interval %u us", m->name, m->frame_us);
+
+out:
+	_FREE_(crtc);
+	_FREE_(sr);
+	_FREE_(info);
+	return m->frame_us;
+}
+
+static void
+set_frame_timer(uint32_t us)
+{
+	struct itimerspec ts = {0};
+	ts.it_value.tv_sec	 = us / 1000000;
+	ts.it_value.tv_nsec	 = (long)(us % 1000000) * 1000;
+	ts.it_interval		 = ts.it_value;
+	if (timerfd_settime(frame_timer_fd, 0, &ts, NULL) != 0) {
+		_LOG_(ERROR, "cannot set frame timer: %s", strerror(errno));
+		return;
+	}
+	frame_timer_armed = us != 0;
+}
+
+/* interactive move/resize commits geometry at most once per refresh
+ * interval of the monitor under the pointer. motion between two frames only
+ * moves the target, the frame timer applies the latest one */
+static void
+queue_mouse_motion(int16_t x, int16_t y)
+{
+	mouse_state.cur_x = x;
+	mouse_state.cur_y = y;
+	if (frame_timer_armed || mouse_sync_busy()) {
+		mouse_state.pending = true;
+		return;
+	}
+	handle_mouse_motion(x, y);
+	if (frame_timer_fd >= 0)
+		set_frame_timer(monitor_frame_us(get_monitor_within_coordinate(x, y)));
+}
+
+/* a resize waits until every client it touches has painted the previous
+ * size, so it goes no faster than those clients can keep up */
+static bool
+mouse_sync_busy(void)
+{
+	if (conf.outline_mode)
+		return false; /* nothing is resized until the button is released */
+	if (mouse_state.op == MOUSE_OP_RESIZE_FLOATING)
+		return client_sync_busy(mouse_state.node->client);
+	if (mouse_state.op == MOUSE_OP_RESIZE_TILED)
+		return subtree_sync_busy(mouse_state.parent);
+	return false;
+}
+
+static void
+on_frame_timer(void)
+{
+	uint64_t expirations;
+	if (read(frame_timer_fd, &expirations, sizeof(expirations)) < 0)
+		return;
+	if (mouse_state.op == MOUSE_OP_NONE || !mouse_state.pending) {
+		/* a frame without motion, stop ticking until the next one */
+		set_frame_timer(0);
+		return;
+	}
+	if (mouse_sync_busy())
+		return; /* still painting the last size, try on the next frame */
+	mouse_state.pending = false;
+	handle_mouse_motion(mouse_state.cur_x, mouse_state.cur_y);
+}
+
+/* outline mode only moved the frame so far, give the client(s) the final
+ * geometry in one go */
+static void
+commit_outline(void)
+{
+	outline_hide();
+	if (mouse_state.op == MOUSE_OP_MOVE_FLOATING ||
+		mouse_state.op == MOUSE_OP_RESIZE_FLOATING) {
+		if (mouse_state.node && mouse_state.node->client)
+			commit_client_geometry(mouse_state.node->client,
+								   mouse_state.node->floating_rectangle,
+								   conf.border_width);
+	} else if (mouse_state.op == MOUSE_OP_RESIZE_TILED) {
+		if (mouse_state.parent)
+			render_tree_nomap(mouse_state.parent);
+	}
+}
+
+static void
+finish_mouse_action(void)
+{
+	/* the last motion may still be waiting for its frame */
+	if (mouse_state.pending)
+		handle_mouse_motion(mouse_state.cur_x, mouse_state.cur_y);
+	if (frame_timer_armed)
+		set_frame_timer(0);
+	if (conf.outline_mode)
+		commit_outline();
+	ungrab_pointer();
+	clear_mouse_state();
+	xcb_flush(wm->connection);
+}
+
+static void
+cancel_mouse_action(void)
+{
+	outline_hide();
+	if (mouse_state.op == MOUSE_OP_MOVE_FLOATING ||
+		mouse_state.op == MOUSE_OP_RESIZE_FLOATING) {
+		if (mouse_state.node && mouse_state.node->client) {
+			mouse_state.node->floating_rectangle = mouse_state.start_rect;
+			commit_client_geometry(mouse_state.node->client,
+								   mouse_state.start_rect,
+								   conf.border_width);
+		}
+	} else if (mouse_state.op == MOUSE_OP_RESIZE_TILED) {
+		if (mouse_state.parent) {
+			mouse_state.parent->split_type	= mouse_state.split_type;
+			mouse_state.parent->split_ratio = mouse_state.start_ratio;
 			resize_subtree(mouse_state.parent);
 			render_tree_nomap(mouse_state.parent);
 		}
 	}
+	if (frame_timer_armed)
+		set_frame_timer(0);
 	ungrab_pointer();
 	clear_mouse_state();
 	xcb_flush(wm->connection);
 }
 
+static int
+key_grab_cmp(const void *a, const void *b)
+{
+	const key_grab_t *x = a;
+	const key_grab_t *y = b;
+	if (x->mod != y->mod)
+		return x->mod < y->mod ? -1 : 1;
+	return (x->keycode > y->keycode) - (x->keycode < y->keycode);
+}
+
+static void
+want_key_grab(key_grab_t  *want,
+			  size_t	  *len,
+			  uint32_t	   mod,
+			  xcb_keysym_t keysym,
+			  xcb_conn_t  *conn)
+{
+	xcb_keycode_t *key = get_keycode(keysym, conn);
+	if (key == NULL || *key == XCB_NO_SYMBOL) {
+		/* not on the current layout, it may come back with the next one */
+		_LOG_(WARNING, "no keycode for keysym %#x", keysym);
+		_FREE_(key);
+		return;
+	}
+	want[(*len)++] = (key_grab_t){.mod = (uint16_t)mod, .keycode = *key};
+	_FREE_(key);
+}
+
+/* grab_keys - brings the key grabs on win in line with the active bindings.
+ *
+ * the (mod, keycode) pairs that should be grabbed are diffed against the
+ * ones grabbed last time, and only the difference is sent, unchecked, with
+ * one round trip at the end. on a reload or a keymap change, keys that did
+ * not change stay grabbed the whole time, so no key press is lost */
 static int
 grab_keys(xcb_conn_t *conn, xcb_window_t win)
 {
@@ -4421,62 +5167,86 @@ grab_keys(xcb_conn_t *conn, xcb_window_t win)
 		return -1;
 	}
 
+	size_t n = 0;
 	if (key_head) {
-		conf_key_t *current = key_head;
-		while (current) {
-			xcb_keycode_t *key = get_keycode(current->keysym, conn);
-			if (key == NULL)
-				return -1;
-			xcb_cookie_t cookie = xcb_grab_key_checked(conn,
-													   1,
-													   win,
-													   (uint16_t)current->mod,
-													   *key,
-													   XCB_GRAB_MODE_ASYNC,
-													   XCB_GRAB_MODE_ASYNC);
-			_FREE_(key);
-			xcb_error_t *err = xcb_request_check(conn, cookie);
-			if (err) {
-				_LOG_(ERROR, "error grabbing key %d", err->error_code);
-				_FREE_(err);
-				return -1;
-			}
-			current = current->next;
+		for (conf_key_t *cur = key_head; cur; cur = cur->next) {
+			n++;
 		}
-		is_kgrabbed = true;
-		grab_super_button(win, XCB_BUTTON_INDEX_1);
-		grab_super_button(win, XCB_BUTTON_INDEX_3);
-		return 0;
+	} else {
+		_LOG_(INFO, "----grabbing default keys------");
+		n = LEN(_keys_);
 	}
 
-	_LOG_(INFO, "----grabbing default keys------");
-	const size_t n = sizeof(_keys_) / sizeof(_keys_[0]);
-
-	for (size_t i = n; i--;) {
-		xcb_keycode_t *key = get_keycode(_keys_[i].keysym, conn);
-		if (key == NULL)
-			return -1;
-		xcb_cookie_t cookie = xcb_grab_key_checked(conn,
-												   1,
-												   win,
-												   (uint16_t)_keys_[i].mod,
-												   *key,
-												   XCB_GRAB_MODE_ASYNC,
-												   XCB_GRAB_MODE_ASYNC);
-		_FREE_(key);
-		xcb_error_t *err = xcb_request_check(conn, cookie);
-		if (err) {
-			_LOG_(ERROR, "error grabbing key %d", err->error_code);
-			_FREE_(err);
-			return -1;
+	key_grab_t *want = calloc(n ? n : 1, sizeof(key_grab_t));
+	if (want == NULL) {
+		_LOG_(ERROR, "failed to allocate key grabs");
+		return -1;
+	}
+	size_t len = 0;
+	if (key_head) {
+		for (conf_key_t *cur = key_head; cur; cur = cur->next) {
+			want_key_grab(want, &len, cur->mod, cur->keysym, conn);
 		}
+	} else {
+		for (size_t i = n; i--;) {
+			want_key_grab(want, &len, _keys_[i].mod, _keys_[i].keysym, conn);
+		}
+	}
+	qsort(want, len, sizeof(key_grab_t), key_grab_cmp);
+	size_t uniq = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (uniq == 0 || key_grab_cmp(&want[uniq - 1], &want[i]) != 0)
+			want[uniq++] = want[i];
+	}
+	len = uniq;
+
+	/* both sets are sorted, walk them side by side */
+	size_t i = 0, j = 0, changed = 0;
+	while (i < grabbed_keys_len || j < len) {
+		int c = 1;
+		if (j == len)
+			c = -1;
+		else if (i < grabbed_keys_len)
+			c = key_grab_cmp(&grabbed_keys[i], &want[j]);
+		xcb_void_cookie_t cookie;
+		if (c < 0) {
+			cookie = xcb_ungrab_key(
+				conn, grabbed_keys[i].keycode, win, grabbed_keys[i].mod);
+			track_request(cookie, win, XREQ_UNGRAB_KEY);
+			i++;
+			changed++;
+		} else if (c > 0) {
+			cookie = xcb_grab_key(conn,
+								  1,
+								  win,
+								  want[j].mod,
+								  want[j].keycode,
+								  XCB_GRAB_MODE_ASYNC,
+								  XCB_GRAB_MODE_ASYNC);
+			track_request(cookie, win, XREQ_GRAB_KEY);
+			j++;
+			changed++;
+		} else {
+			i++;
+			j++;
+		}
+	}
+	changed += grab_super_buttons(conn, win);
+	if (changed) {
+		/* one round trip for all of them, errors (e.g. a key grabbed by
+		 * another client) come back as events and are logged there */
+		xcb_get_input_focus_reply_t *sync =
+			xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL);
+		_FREE_(sync);
+		_LOG_(INFO, "updated %zu key and button grabs", changed);
 	}
-	is_kgrabbed = true;
 
-	grab_super_button(win, XCB_BUTTON_INDEX_1);
-	grab_super_button(win, XCB_BUTTON_INDEX_3);
+	_FREE_(grabbed_keys);
+	grabbed_keys	 = want;
+	grabbed_keys_len = len;
+	is_kgrabbed		 = true;
 
-	return 0;
+	return build_key_table();
 }
 
 static xcb_atom_t
@@ -4576,23 +5346,6 @@ close_or_kill(xcb_window_t win)
 	return 0;
 }
 
-static void
-ungrab_keys(xcb_conn_t *conn, xcb_window_t win)
-{
-	if (conn == NULL || win == XCB_NONE) {
-		return;
-	}
-
-	const xcb_keycode_t modifier = (xcb_keycode_t)XCB_MOD_MASK_ANY;
-	xcb_cookie_t		cookie =
-		xcb_ungrab_key_checked(conn, XCB_GRAB_ANY, win, modifier);
-	xcb_error_t *err = xcb_request_check(conn, cookie);
-	if (err) {
-		_LOG_(ERROR, "error ungrabbing keys: %d", err->error_code);
-		_FREE_(err);
-	}
-}
-
 /* map_floating - is called on windows that I do not wanna insert into the tree,
  * like notification windows and many other short-lived windows. Not to confuse
  * this with handle_floating_window, that function inserts floating windows into
@@ -4612,8 +5365,7 @@ map_floating(xcb_window_t x)
 	rc.y	  = g->y;
 
 	_FREE_(g);
-	resize_window(x, rc.width, rc.height);
-	move_window(x, rc.x, rc.y);
+	configure_geometry(x, rc, conf.border_width);
 	xcb_map_window(wm->connection, x);
 }
 
@@ -4627,20 +5379,13 @@ find_window_in_desktops(desktop_t  **curr_desktop,
 						xcb_window_t win,
 						bool		*found)
 {
-	monitor_t *curr = head_monitor;
-	while (curr) {
-		for (int i = 0; i < curr->n_of_desktops; i++) {
-			desktop_t *d = curr->desktops[i];
-			node_t	  *n = find_node_by_window_id(d->tree, win);
-			if (n) {
-				*curr_desktop = d;
-				*curr_node	  = n;
-				*found		  = true;
-				_LOG_(DEBUG, "window %d found in desktop %d", win, i);
-				return;
-			}
-		}
-		curr = curr->next;
+	winmap_entry_t *e = winmap_get(win);
+	if (e) {
+		*curr_desktop = e->desktop;
+		*curr_node	  = e->node;
+		*found		  = true;
+		_LOG_(DEBUG, "window %d found in desktop %d", win, e->desktop->id);
+		return;
 	}
 	_LOG_(ERROR, "window %d not found in any desktop", win);
 }
@@ -4648,17 +5393,7 @@ find_window_in_desktops(desktop_t  **curr_desktop,
 static bool
 client_exist_in_desktops(xcb_window_t win)
 {
-	monitor_t *curr = head_monitor;
-	while (curr) {
-		for (int i = 0; i < curr->n_of_desktops; ++i) {
-			if (!is_tree_empty(curr->desktops[i]->tree)) {
-				if (client_exist(curr->desktops[i]->tree, win))
-					return true;
-			}
-		}
-		curr = curr->next;
-	}
-	return false;
+	return winmap_get(win) != NULL;
 }
 
 static int
@@ -4748,7 +5483,7 @@ kill_window(xcb_window_t win)
 	_LOG_(DEBUG, "[KILL_WINDOW] calling delete_node for win=%d", c->window);
 #endif
 	delete_node(n, d);
-	ewmh_update_client_list();
+	mark_dirty(DIRTY_CLIENT_LIST);
 
 	if (is_tree_empty(d->tree)) {
 		set_active_window_name(XCB_NONE);
@@ -4757,12 +5492,9 @@ kill_window(xcb_window_t win)
 	}
 
 	if (!another_desktop) {
-		if (render_tree(d->tree) != 0) {
-			_LOG_(ERROR, "cannot render tree");
-			return -1;
-		}
+		mark_desktop_dirty(d);
 	}
-	restack();
+	mark_dirty(DIRTY_STACK);
 
 #ifdef _DEBUG__
 	_LOG_(DEBUG, "[KILL_WINDOW] kill_window complete for win=%d", win);
@@ -4773,42 +5505,21 @@ kill_window(xcb_window_t win)
 static node_t *
 find_node_global(xcb_window_t win)
 {
+	winmap_entry_t *e = winmap_get(win);
 #ifdef _DEBUG__
-	char *name = win_name(win);
-	_LOG_(
-		DEBUG,
-		"[FIND_NODE_GLOBAL] searching for win=%d name='%s' across all desktops",
-		win,
-		name ? name : "(null)");
-	_FREE_(name);
-#endif
-	monitor_t *m = head_monitor;
-
-	while (m) {
-		for (int i = 0; i < m->n_of_desktops; i++) {
-			desktop_t *d = m->desktops[i];
-			if (!d || !d->tree)
-				continue;
-			node_t *n = find_node_by_window_id(d->tree, win);
-			if (n) {
-#ifdef _DEBUG__
-				_LOG_(DEBUG,
-					  "[FIND_NODE_GLOBAL] window %d found in monitor='%s' "
-					  "desktop=%d",
-					  win,
-					  m->name,
-					  d->id);
-#endif
-				return n;
-			}
-		}
-		m = m->next;
+	if (e) {
+		_LOG_(DEBUG,
+			  "[FIND_NODE_GLOBAL] window %d found in monitor='%s' desktop=%d",
+			  win,
+			  e->monitor ? e->monitor->name : "(null)",
+			  e->desktop->id);
+	} else {
+		_LOG_(DEBUG,
+			  "[FIND_NODE_GLOBAL] window %d not found in ANY desktop",
+			  win);
 	}
-
-#ifdef _DEBUG__
-	_LOG_(DEBUG, "[FIND_NODE_GLOBAL] window %d not found in ANY desktop", win);
 #endif
-	return NULL;
+	return e ? e->node : NULL;
 }
 
 int
@@ -4823,6 +5534,130 @@ set_visibility(xcb_window_t win, bool is_visible)
 		  is_visible ? "TRUE" : "FALSE");
 	_FREE_(name);
 #endif
+	const vis_change_t v = {.window = win, .visible = is_visible};
+	if (!vis_batching)
+		return apply_visibility(&v, 1);
+
+	if (vis_batch_len == vis_batch_cap) {
+		size_t		  cap	= vis_batch_cap ? vis_batch_cap * 2 : 32;
+		vis_change_t *grown = realloc(vis_batch, cap * sizeof(*grown));
+		if (grown == NULL) {
+			_LOG_(ERROR, "failed to grow visibility batch");
+			return -1;
+		}
+		vis_batch	  = grown;
+		vis_batch_cap = cap;
+	}
+	vis_batch[vis_batch_len++] = v;
+	return 0;
+}
+
+/* from here until commit_visibility_batch(), set_visibility() only queues */
+void
+begin_visibility_batch(void)
+{
+	vis_batching  = true;
+	vis_batch_len = 0;
+}
+
+int
+commit_visibility_batch(void)
+{
+	vis_batching  = false;
+	int ret		  = apply_visibility(vis_batch, vis_batch_len);
+	vis_batch_len = 0;
+	return ret;
+}
+
+/* sends the WM_STATE, _NET_WM_STATE and map/unmap requests for one window.
+ * ck is its pending _NET_WM_STATE read */
+static void
+stage_visibility(const vis_change_t *v, xcb_get_property_cookie_t ck)
+{
+	xcb_conn_t		*conn	= wm->connection;
+	const xcb_atom_t net_s	= wm->ewmh->_NET_WM_STATE;
+	const xcb_atom_t hidden = wm->ewmh->_NET_WM_STATE_HIDDEN;
+	const bool		 show	= v->visible;
+	xcb_cookie_t	 c;
+
+	/* According to ewmh:
+	 * Mapped windows should be placed in NormalState, unmapped windows in
+	 * IconicState, according to the ICCCM. Windows which are actually
+	 * iconified or minimized should have the _NET_WM_STATE_HIDDEN property
+	 * set, to communicate to pagers that the window should not be
+	 * represented as "onscreen." */
+	const long data[] = {
+		show ? XCB_ICCCM_WM_STATE_NORMAL : XCB_ICCCM_WM_STATE_ICONIC, XCB_NONE};
+	c = xcb_change_property(conn,
+							XCB_PROP_MODE_REPLACE,
+							v->window,
+							wm_state_atom,
+							wm_state_atom,
+							32,
+							2,
+							data);
+	track_request(c, v->window, XREQ_PROPERTY);
+
+	xcb_get_property_reply_t *r = xcb_get_property_reply(conn, ck, NULL);
+	if (r) {
+		const xcb_atom_t *atoms = xcb_get_property_value(r);
+		const int		  len =
+			  r->format == 32 ? xcb_get_property_value_length(r) / 4 : 0;
+		xcb_atom_t values[len + 1];
+		int		   num = 0;
+		bool	   had = false;
+		for (int i = 0; i < len; i++) {
+			if (atoms[i] == hidden)
+				had = true;
+			else
+				values[num++] = atoms[i];
+		}
+		if (!show)
+			values[num++] = hidden;
+		/* leave the property alone when HIDDEN is already right */
+		if (had == show) {
+			c = xcb_change_property(conn,
+									XCB_PROP_MODE_REPLACE,
+									v->window,
+									net_s,
+									XCB_ATOM_ATOM,
+									32,
+									num,
+									values);
+			track_request(c, v->window, XREQ_PROPERTY);
+		}
+		_FREE_(r);
+	}
+
+	node_t	 *n	 = find_node_global(v->window);
+	client_t *cl = n ? n->client : NULL;
+	if (cl) {
+		update_client_ewmh_state(cl, EWMH_STATE_HIDDEN, !show);
+	}
+
+	if (show) {
+		c = xcb_map_window(conn, v->window);
+		track_request(c, v->window, XREQ_MAP);
+	} else {
+		c = xcb_unmap_window(conn, v->window);
+		track_request(c, v->window, XREQ_UNMAP);
+	}
+	if (cl) {
+		cl->shadow.mapped = show;
+		shadow_writes++;
+	}
+}
+
+/* applies a whole set of map/unmap changes with the root event mask turned
+ * off once around all of them and a single round trip at the end, so the
+ * cost of a desktop switch does not grow with the number of windows */
+static int
+apply_visibility(const vis_change_t *v, size_t n)
+{
+	if (n == 0)
+		return 0;
+
+	xcb_conn_t *conn = wm->connection;
 	/* zwm must NOT recieve events before mapping (showing) or unmapping
 	 * (hiding) windows.
 	 * otherwise, it will recieve unmap/map notify and handle it as it
@@ -4831,64 +5666,53 @@ set_visibility(xcb_window_t win, bool is_visible)
 	const uint32_t _off[] = {ROOT_EVENT_MASK &
 							 ~XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY};
 	const uint32_t _on[]  = {ROOT_EVENT_MASK};
-	xcb_error_t	  *err;
-	xcb_cookie_t   c;
-	int			   ret = 0;
 
-	/* stop zwm from recieving events */
-	c				   = xcb_change_window_attributes_checked(
-		 wm->connection, wm->root_window, XCB_CW_EVENT_MASK, _off);
-	err = xcb_request_check(wm->connection, c);
-	if (err) {
-		_LOG_(ERROR,
-			  "cannot change root window %d attrs: error code %d",
-			  wm->root_window,
-			  err->error_code);
-		_FREE_(err);
+	xcb_get_property_cookie_t *state = malloc(n * sizeof(*state));
+	if (state == NULL) {
+		_LOG_(ERROR, "failed to allocate visibility batch");
 		return -1;
 	}
-	/* node_t *n = find_node_global(win); */
-	/* if (!n) { */
-	/* _LOG_(ERROR, "cannot fin win %d", win); */
-	/* return -1; */
-	/* } */
-	/* ret = is_visible ? show_window(win, n) : hide_window(win); */
-#ifdef _DEBUG__
-	_LOG_(DEBUG,
-		  "[VISIBILITY] calling %s for win=%d",
-		  is_visible ? "show_window" : "hide_window",
-		  win);
-#endif
-	ret = is_visible ? show_window(win) : hide_window(win);
-	if (ret == -1) {
-		_LOG_(
-			ERROR, "cannot set visibilty to %s", is_visible ? "true" : "false");
-#ifdef _DEBUG__
-	} else {
-		_LOG_(DEBUG,
-			  "[VISIBILITY] successfully set visibility to %s for win=%d",
-			  is_visible ? "true" : "false",
-			  win);
-#endif
+
+	/* stop zwm from recieving events */
+	xcb_cookie_t c = xcb_change_window_attributes(
+		conn, wm->root_window, XCB_CW_EVENT_MASK, _off);
+	track_request(c, wm->root_window, XREQ_EVENT_MASK);
+
+	for (size_t i = 0; i < n; i++) {
+		state[i] = xcb_get_property(conn,
+									false,
+									v[i].window,
+									wm->ewmh->_NET_WM_STATE,
+									XCB_ATOM_ATOM,
+									0,
+									64);
 	}
 
+	/* unmap the old windows before mapping the new ones */
+	for (size_t i = 0; i < n; i++) {
+		if (!v[i].visible)
+			stage_visibility(&v[i], state[i]);
+	}
+	for (size_t i = 0; i < n; i++) {
+		if (v[i].visible)
+			stage_visibility(&v[i], state[i]);
+	}
+	_FREE_(state);
+
 	/* subscribe for events again */
-	c = xcb_change_window_attributes_checked(
-		wm->connection, wm->root_window, XCB_CW_EVENT_MASK, _on);
-	err = xcb_request_check(wm->connection, c);
-	if (err) {
-		_LOG_(ERROR,
-			  "cannot change root window %d attrs: error code %d",
-			  wm->root_window,
-			  err->error_code);
-		_FREE_(err);
+	c = xcb_change_window_attributes(
+		conn, wm->root_window, XCB_CW_EVENT_MASK, _on);
+	track_request(c, wm->root_window, XREQ_EVENT_MASK);
+
+	/* one round trip: the server has handled the whole batch when it
+	 * answers, and any errors are already queued for handle_x_error */
+	xcb_get_input_focus_reply_t *sync =
+		xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL);
+	if (sync == NULL) {
+		_LOG_(ERROR, "connection lost while applying visibility batch");
 		return -1;
 	}
-#ifdef _DEBUG__
-	_LOG_(DEBUG,
-		  "[VISIBILITY] set_visibility completed successfully for win=%d",
-		  win);
-#endif
+	_FREE_(sync);
 	return 0;
 }
 
@@ -4944,61 +5768,6 @@ _LOG_(ERROR, "show_window: node has no client for win=%d", win);
 }
 #endif
 
-static int
-show_window(xcb_window_t win)
-{
-#ifdef _DEBUG__
-	char *name = win_name(win);
-	_LOG_(DEBUG,
-		  "[SHOW_WINDOW] showing win=%d name='%s' (setting WM_STATE to NORMAL, "
-		  "then mapping)",
-		  win,
-		  name ? name : "(null)");
-	_FREE_(name);
-#endif
-	xcb_error_t		*err;
-	xcb_cookie_t	 c;
-	/* According to ewmh:
-	 * Mapped windows should be placed in NormalState, according to
-	 * the ICCCM */
-	const long		 data[] = {XCB_ICCCM_WM_STATE_NORMAL, XCB_NONE};
-	const xcb_atom_t wm_s	= get_atom("WM_STATE", wm->connection);
-	c						= xcb_change_property_checked(
-		  wm->connection, XCB_PROP_MODE_REPLACE, win, wm_s, wm_s, 32, 2, data);
-	err = xcb_request_check(wm->connection, c);
-
-	if (err) {
-		_LOG_(ERROR,
-			  "cannot change window property %d: error code %d",
-			  win,
-			  err->error_code);
-		_FREE_(err);
-		return -1;
-	}
-
-	update_net_wm_state_atom(win, wm->ewmh->_NET_WM_STATE_HIDDEN, false);
-	node_t *n = find_node_global(win);
-	if (n && n->client) {
-		update_client_ewmh_state(n->client, EWMH_STATE_HIDDEN, false);
-	}
-
-	c	= xcb_map_window_checked(wm->connection, win);
-	err = xcb_request_check(wm->connection, c);
-
-	if (err) {
-		_LOG_(ERROR,
-			  "cannot hide window %d: error code %d",
-			  win,
-			  err->error_code);
-		_FREE_(err);
-		return -1;
-	}
-#ifdef _DEBUG__
-	_LOG_(DEBUG, "[SHOW_WINDOW] successfully mapped win=%d", win);
-#endif
-	return 0;
-}
-
 #if 0
 static int
 hide_window(xcb_window_t win)
@@ -5031,64 +5800,6 @@ _LOG_(DEBUG, "hiding window %d at (%d, %d)", win, offscreen, offscreen);
 }
 #endif
 
-static int
-hide_window(xcb_window_t win)
-{
-#ifdef _DEBUG__
-	char *name = win_name(win);
-	_LOG_(DEBUG,
-		  "[HIDE_WINDOW] hiding win=%d name='%s' (setting WM_STATE to ICONIC, "
-		  "then unmapping)",
-		  win,
-		  name ? name : "(null)");
-	_FREE_(name);
-#endif
-	xcb_error_t		*err;
-	xcb_cookie_t	 c;
-	/* According to ewmh:
-	 * Unmapped windows should be placed in IconicState, according to
-	 * the ICCCM. Windows which are actually iconified or minimized
-	 * should have the _NET_WM_STATE_HIDDEN property set, to
-	 * communicate to pagers that the window should not be represented
-	 * as "onscreen."
-	 **/
-	const long		 data[] = {XCB_ICCCM_WM_STATE_ICONIC, XCB_NONE};
-	const xcb_atom_t wm_s	= get_atom("WM_STATE", wm->connection);
-	c						= xcb_change_property_checked(
-		  wm->connection, XCB_PROP_MODE_REPLACE, win, wm_s, wm_s, 32, 2, data);
-	err = xcb_request_check(wm->connection, c);
-
-	if (err) {
-		_LOG_(ERROR,
-			  "cannot change window property %d: error code %d",
-			  win,
-			  err->error_code);
-		_FREE_(err);
-		return -1;
-	}
-
-	update_net_wm_state_atom(win, wm->ewmh->_NET_WM_STATE_HIDDEN, true);
-	node_t *n = find_node_global(win);
-	if (n && n->client) {
-		update_client_ewmh_state(n->client, EWMH_STATE_HIDDEN, true);
-	}
-
-	c	= xcb_unmap_window_checked(wm->connection, win);
-	err = xcb_request_check(wm->connection, c);
-	if (err) {
-		_LOG_(ERROR,
-			  "cannot hide window %d: error code %d",
-			  win,
-			  err->error_code);
-		_FREE_(err);
-		return -1;
-	}
-#ifdef _DEBUG__
-	_LOG_(DEBUG, "[HIDE_WINDOW] successfully unmapped win=%d", win);
-#endif
-	return 0;
-}
-
 int
 exec_process(arg_t *arg)
 {
@@ -5153,14 +5864,11 @@ set_focus(node_t *n, bool flag)
 	n->is_focused = flag;
 
 	/* Skip focus attempt if trying to set focus on unmapped window */
-	if (flag) {
-		if (!check_window_map_state(n->client->window,
-									WIN_MAP_STATE_VIEWABLE)) {
-			return 0; /* Not an error - just skip focusing */
-		}
+	if (flag && !n->client->shadow.mapped) {
+		return 0; /* Not an error - just skip focusing */
 	}
 
-	if (win_focus(n->client->window, flag) != 0) {
+	if (win_focus(n->client, flag) != 0) {
 		_LOG_(ERROR, "cannot set focus");
 		return -1;
 	}
@@ -5177,18 +5885,74 @@ switch_desktop_wrapper(arg_t *arg)
 	if (arg->idx > conf.virtual_desktops) {
 		return 0;
 	}
+	begin_transition();
 	if (switch_desktop(arg->idx) != 0) {
+		end_transition();
 		return -1;
 	}
 	last_desk_switch_time = get_time_millis();
-	node_t *tree		  = curr_monitor->desk->tree;
-	int		ret			  = render_tree(tree);
-	restack();
-	return ret;
+	mark_desktop_dirty(curr_monitor->desk);
+	mark_dirty(DIRTY_STACK);
+	end_transition();
+	return 0;
+}
+
+/* with atomic_transitions set, other clients (and compositors) see only the
+ * finished result of a transition instead of every intermediate step.
+ * calls nest, only the outermost pair grabs and releases the server */
+static void
+begin_transition(void)
+{
+	if (transition_depth++ > 0)
+		return;
+	if (!conf.atomic_transitions || transition_misses >= TRANSITION_MAX_MISS)
+		return;
+	xcb_grab_server(wm->connection);
+	transition_grabbed = true;
+	transition_start   = get_time_millis();
+}
+
+/* a grab that outlives TRANSITION_MAX_HOLD stalls every other client, so
+ * after TRANSITION_MAX_MISS such overruns in a row transitions fall back to
+ * running ungrabbed until the config is reloaded */
+static void
+end_transition(void)
+{
+	if (transition_depth == 0 || --transition_depth > 0)
+		return;
+	if (!transition_grabbed)
+		return;
+
+	/* deferred work of the transition lands inside the grab too */
+	commit_dirty();
+	xcb_ungrab_server(wm->connection);
+	xcb_flush(wm->connection);
+	transition_grabbed = false;
+
+	const uint64_t held = get_time_millis() - transition_start;
+	if (held <= TRANSITION_MAX_HOLD) {
+		transition_misses = 0;
+		return;
+	}
+	_LOG_(WARNING,
+		  "transition held the server for %llu ms",
+		  (unsigned long long)held);
+	if (++transition_misses == TRANSITION_MAX_MISS) {
+		_LOG_(WARNING, "disabling atomic transitions after repeated overruns");
+	}
 }
 
 static int
 switch_desktop(const int nd)
+{
+	begin_transition();
+	int ret = do_switch_desktop(nd);
+	end_transition();
+	return ret;
+}
+
+static int
+do_switch_desktop(const int nd)
 {
 #ifdef _DEBUG__
 	_LOG_(DEBUG, "[SWITCH_DESKTOP] ========== DESKTOP SWITCH START ==========");
@@ -5223,6 +5987,8 @@ switch_desktop(const int nd)
 #endif
 	update_focused_desktop(nd);
 
+	/* queue every unmap and map of the switch and send them together */
+	begin_visibility_batch();
 #ifdef _DEBUG__
 	_LOG_(DEBUG,
 		  "[SWITCH_DESKTOP] calling hide_windows for desktop %d tree",
@@ -5232,6 +5998,7 @@ switch_desktop(const int nd)
 #ifdef _DEBUG__
 		_LOG_(ERROR, "[SWITCH_DESKTOP] hide_windows failed for old desktop");
 #endif
+		commit_visibility_batch();
 		return -1;
 	}
 
@@ -5243,10 +6010,18 @@ switch_desktop(const int nd)
 #ifdef _DEBUG__
 		_LOG_(ERROR, "[SWITCH_DESKTOP] show_windows failed for desktop %d", nd);
 #endif
+		commit_visibility_batch();
+		return -1;
+	}
+	if (commit_visibility_batch() != 0) {
+		_LOG_(ERROR, "cannot apply visibility for desktop %d", nd);
 		return -1;
 	}
 	set_active_window_name(XCB_NONE);
-	win_focus(focused_win, false);
+	node_t *fn = find_node_global(focused_win);
+	if (fn && fn->client) {
+		win_focus(fn->client, false);
+	}
 	focused_win = XCB_NONE;
 	/* restore focus only if layout is not STACK */
 	if (conf.restore_last_focus) {
@@ -5288,7 +6063,6 @@ switch_desktop(const int nd)
 	}
 
 	/* restack(); */
-	xcb_flush(wm->connection);
 
 #ifdef _DEBUG__
 	_LOG_(DEBUG,
@@ -5308,7 +6082,7 @@ fill_root_rectangle(rectangle_t *r)
 }
 
 static void
-fill_floating_rectangle(xcb_get_geometry_reply_t *geometry, rectangle_t *r)
+fill_floating_rectangle(const rectangle_t *geometry, rectangle_t *r)
 {
 	int x = curr_monitor->rectangle.x + (curr_monitor->rectangle.width / 2) -
 			(geometry->width / 2);
@@ -5333,9 +6107,9 @@ cycle_desktop_wrapper(arg_t *arg)
 	int next = (current + (arg->d == RIGHT ? 1 : -1) + n_desktops) % n_desktops;
 
 	switch_desktop(next);
-	int ret = render_tree(curr_monitor->desktops[next]->tree);
-	restack();
-	return ret;
+	mark_desktop_dirty(curr_monitor->desktops[next]);
+	mark_dirty(DIRTY_STACK);
+	return 0;
 }
 
 static int
@@ -5358,7 +6132,7 @@ static int
 set_window_state(xcb_window_t win, xcb_icccm_wm_state_t state)
 {
 	const long	 data[] = {state, XCB_NONE};
-	xcb_atom_t	 t		= get_atom("WM_STATE", wm->connection);
+	xcb_atom_t	 t		= wm_state_atom;
 	xcb_cookie_t c		= xcb_change_property_checked(
 		 wm->connection, XCB_PROP_MODE_REPLACE, win, t, t, 32, 2, data);
 	xcb_error_t *err = xcb_request_check(wm->connection, c);
@@ -5391,44 +6165,21 @@ update_net_wm_desktop(xcb_window_t win, uint32_t desktop)
 	return 0;
 }
 
-static bool
-should_manage(xcb_window_t win, xcb_conn_t *conn)
-{
-	xcb_get_window_attributes_cookie_t attr_cookie;
-	xcb_get_window_attributes_reply_t *attr_reply;
-
-	attr_cookie = xcb_get_window_attributes(conn, win);
-	attr_reply	= xcb_get_window_attributes_reply(conn, attr_cookie, NULL);
-
-	if (attr_reply == NULL) {
-		return true;
-	}
-
-	bool manage = !attr_reply->override_redirect;
-	_FREE_(attr_reply);
-	return manage;
-}
-
 static int
-apply_floating_hints(xcb_window_t win)
+apply_floating_hints(const window_props_t *p)
 {
-	xcb_get_property_cookie_t c =
-		xcb_icccm_get_wm_normal_hints(wm->connection, win);
-	xcb_size_hints_t size_hints;
-
-	uint8_t			 r = xcb_icccm_get_wm_normal_hints_reply(
-		 wm->connection, c, &size_hints, NULL);
-	if (1 == r) {
+	if (p->has_size_hints) {
 		/* if min-h == max-h && min-w == max-w, */
 		/* then window should be floated */
 		uint32_t size_mask =
 			(XCB_ICCCM_SIZE_HINT_P_MIN_SIZE | XCB_ICCCM_SIZE_HINT_P_MAX_SIZE);
-		int32_t miw = size_hints.min_width;
-		int32_t mxw = size_hints.max_width;
-		int32_t mih = size_hints.min_height;
-		int32_t mxh = size_hints.max_height;
+		int32_t miw = p->size_hints.min_width;
+		int32_t mxw = p->size_hints.max_width;
+		int32_t mih = p->size_hints.min_height;
+		int32_t mxh = p->size_hints.max_height;
 
-		if ((size_hints.flags & size_mask) && (miw == mxw) && (mih == mxh)) {
+		if ((p->size_hints.flags & size_mask) && (miw == mxw) &&
+			(mih == mxh)) {
 			return 0;
 		}
 	}
@@ -5438,18 +6189,8 @@ apply_floating_hints(xcb_window_t win)
 static int
 find_desktop_by_window(xcb_window_t win)
 {
-	monitor_t *curr = head_monitor;
-	while (curr) {
-		for (int i = 0; i < curr->n_of_desktops; i++) {
-			desktop_t *d = curr->desktops[i];
-			node_t	  *n = find_node_by_window_id(d->tree, win);
-			if (n) {
-				return d->id;
-			}
-		}
-		curr = curr->next;
-	}
-	return -1;
+	winmap_entry_t *e = winmap_get(win);
+	return e ? e->desktop->id : -1;
 }
 
 static ewmh_window_type_t
@@ -5517,15 +6258,22 @@ window_type(xcb_window_t win)
 		return WINDOW_TYPE_UNKNOWN;
 	}
 
+	ewmh_window_type_t type =
+		window_type_from_atoms(w_type.atoms, w_type.atoms_len);
+	xcb_ewmh_get_atoms_reply_wipe(&w_type);
+	return type;
+}
+
+static ewmh_window_type_t
+window_type_from_atoms(const xcb_atom_t *atoms, uint32_t len)
+{
 	ewmh_window_type_t type = WINDOW_TYPE_NORMAL;
-	for (unsigned int i = 0; i < w_type.atoms_len; ++i) {
-		type = determine_window_type(wm->ewmh, w_type.atoms[i]);
+	for (uint32_t i = 0; i < len; ++i) {
+		type = determine_window_type(wm->ewmh, atoms[i]);
 		if (type != WINDOW_TYPE_NORMAL) {
 			break;
 		}
 	}
-
-	xcb_ewmh_get_atoms_reply_wipe(&w_type);
 	return type;
 }
 
@@ -5609,44 +6357,143 @@ compute_layer(const client_t *c)
 	return LAYER_NORMAL;
 }
 
-static inline uint8_t
-transient_depth(const client_t *c)
+/* refresh_client_layer - recompute the cached layer. called whenever one of
+ * its inputs changes: state, _NET_WM_STATE or the window type */
+void
+refresh_client_layer(client_t *c)
+{
+	c->layer = compute_layer(c);
+}
+
+static void set_transient_depth(client_t *c, uint8_t depth);
+
+static void
+inherit_transient_depth(winmap_entry_t *e, void *arg)
 {
-	uint8_t		 depth = 0;
-	xcb_window_t cur   = c->transient_for;
-	while (cur) {
-		node_t *p = find_node_global(cur);
-		if (!p)
-			break;
-		depth++;
-		cur = p->client->transient_for;
+	client_t	   *c = e->node ? e->node->client : NULL;
+	const client_t *p = arg;
+	if (c && c->transient_parent == p) {
+		set_transient_depth(c,
+							p->transient_depth < UINT8_MAX
+								? p->transient_depth + 1
+								: UINT8_MAX);
+	}
+}
+
+/* set_transient_depth - sets the depth of c and carries it down to the
+ * transients below it. stops where nothing changes, which also ends
+ * WM_TRANSIENT_FOR loops once the depth saturates */
+static void
+set_transient_depth(client_t *c, uint8_t depth)
+{
+	if (c->transient_depth == depth) {
+		return;
+	}
+	c->transient_depth = depth;
+	if (c->n_transients) {
+		winmap_foreach(inherit_transient_depth, c);
+	}
+}
+
+/* link_transient - resolve WM_TRANSIENT_FOR to a managed client and cache the
+ * parent and depth, so stack_key never has to look them up */
+static void
+link_transient(client_t *c)
+{
+	if (c->transient_parent) {
+		c->transient_parent->n_transients--;
+		c->transient_parent = NULL;
+	}
+
+	node_t *p = find_node_global(c->transient_for);
+	if (p == NULL || p->client == NULL || p->client == c) {
+		set_transient_depth(c, 0);
+		return;
+	}
+	c->transient_parent = p->client;
+	p->client->n_transients++;
+	set_transient_depth(c,
+						p->client->transient_depth < UINT8_MAX
+							? p->client->transient_depth + 1
+							: UINT8_MAX);
+}
+
+static void
+adopt_transient(winmap_entry_t *e, void *arg)
+{
+	client_t	   *c = e->node ? e->node->client : NULL;
+	const client_t *p = arg;
+	if (c && c != p && c->transient_parent == NULL &&
+		c->transient_for == p->window) {
+		link_transient(c);
+		mark_dirty(DIRTY_STACK);
+	}
+}
+
+/* adopt_transients - c was just managed, link the transients that were
+ * mapped before it and name it in WM_TRANSIENT_FOR */
+static void
+adopt_transients(client_t *c)
+{
+	winmap_foreach(adopt_transient, c);
+}
+
+static void
+orphan_transient(winmap_entry_t *e, void *arg)
+{
+	client_t *c = e->node ? e->node->client : NULL;
+	if (c && c->transient_parent == arg) {
+		c->transient_parent = NULL;
+		set_transient_depth(c, 0);
+	}
+}
+
+/* unlink_client_transients - c is about to be freed, drop every cached
+ * pointer to it */
+static void
+unlink_client_transients(client_t *c)
+{
+	if (c->transient_parent) {
+		c->transient_parent->n_transients--;
+		c->transient_parent = NULL;
 	}
-	/* 0 = toplevel, 1 = direct transient */
-	return depth;
+	if (c->n_transients) {
+		winmap_foreach(orphan_transient, c);
+		c->n_transients = 0;
+	}
+}
+
+/* release_client - c is about to be freed, drop what refers to it and what
+ * the server keeps on its behalf */
+void
+release_client(client_t *c)
+{
+	unlink_client_transients(c);
+	if (c->sync_alarm == XCB_NONE)
+		return;
+	winmap_alarm_remove(c->sync_alarm);
+	if (wm && wm->connection) {
+		xcb_cookie_t ck = xcb_sync_destroy_alarm(wm->connection, c->sync_alarm);
+		track_request(ck, c->window, XREQ_SYNC);
+	}
+	c->sync_alarm = XCB_NONE;
 }
 
 uint64_t
 stack_key(const client_t *c)
 {
-	layer_t		   layer   = compute_layer(c);
-	const uint8_t  depth   = transient_depth(c);
+	layer_t		   layer   = c->layer;
 	const uint32_t mru	   = c->mru_seq;
 	const uint8_t  visible = ewmh_has(c->ewmh_state, EWMH_STATE_HIDDEN) ? 0 : 1;
 
 	/* transients are at least at their parent's layer */
-	if (c->transient_for) {
-		node_t *p = find_node_global(c->transient_for);
-		if (p && p->client) {
-			layer_t parent_layer = compute_layer(p->client);
-			if (parent_layer > layer) {
-				layer = parent_layer;
-			}
-		}
+	if (c->transient_parent && c->transient_parent->layer > layer) {
+		layer = c->transient_parent->layer;
 	}
 
 	/* [1 bit visible][7 bits layer][8 bits transient depth][40 bits MRU] */
 	return ((uint64_t)visible << 63) | ((uint64_t)layer << 56) |
-		   ((uint64_t)depth << 40) | ((uint64_t)mru);
+		   ((uint64_t)c->transient_depth << 40) | ((uint64_t)mru);
 }
 
 uint32_t
@@ -5661,17 +6508,8 @@ get_next_mru_seq(monitor_t *monitor)
 monitor_t *
 get_monitor_by_window(xcb_window_t win)
 {
-	monitor_t *curr = head_monitor;
-	while (curr) {
-		for (int i = 0; i < curr->n_of_desktops; i++) {
-			node_t *node = find_node_by_window_id(curr->desktops[i]->tree, win);
-			if (node) {
-				return curr;
-			}
-		}
-		curr = curr->next;
-	}
-	return NULL;
+	winmap_entry_t *e = winmap_get(win);
+	return e ? e->monitor : NULL;
 }
 
 static int
@@ -5693,14 +6531,15 @@ handle_first_window(client_t *client, desktop_t *d)
 	d->tree			   = init_root();
 	d->tree->client	   = client;
 	d->tree->rectangle = r;
+	winmap_put(client->window, d->tree, d, curr_monitor);
 	d->n_count += 1;
 	update_net_wm_desktop(client->window, d->id);
 	set_focus(d->tree, true);
 	/*d->node = d->tree;*/
-	ewmh_update_client_list();
+	mark_dirty(DIRTY_CLIENT_LIST);
 	client->mru_seq = get_next_mru_seq(curr_monitor);
 	int ret			= tile(d->tree);
-	restack();
+	mark_dirty(DIRTY_STACK);
 	return ret;
 }
 
@@ -5712,8 +6551,7 @@ handle_subsequent_window(client_t *client, desktop_t *d)
 	_LOG_(DEBUG, "handling tiled window %s id %d", name, client->window);
 	_FREE_(name);
 #endif
-	xcb_window_t wi = get_window_under_cursor(wm->connection, wm->root_window);
-	node_t		*n	= NULL;
+	node_t *n = NULL;
 
 	if (client == NULL) {
 		_LOG_(ERROR, "client is null");
@@ -5741,6 +6579,7 @@ handle_subsequent_window(client_t *client, desktop_t *d)
 
 	node_t *new_node = create_node(client);
 	if (new_node == NULL) {
+		pool_client_free(client);
 		_LOG_(ERROR, "new node is null");
 		return -1;
 	}
@@ -5752,15 +6591,17 @@ handle_subsequent_window(client_t *client, desktop_t *d)
 	}
 	update_net_wm_desktop(client->window, d->id);
 	/*curr_monitor->desk->node = new_node;*/
-	ewmh_update_client_list();
+	mark_dirty(DIRTY_CLIENT_LIST);
 	client->mru_seq = get_next_mru_seq(curr_monitor);
 	int ret			= render_tree(d->tree);
-	restack();
+	mark_dirty(DIRTY_STACK);
 	return ret;
 }
 
 static int
-handle_floating_window(client_t *client, desktop_t *d)
+handle_floating_window(client_t *client,
+					   desktop_t *d,
+					   const window_props_t *p)
 {
 #ifdef _DEBUG__
 	char *name = win_name(client->window);
@@ -5768,7 +6609,11 @@ handle_floating_window(client_t *client, desktop_t *d)
 	_FREE_(name);
 #endif
 
-	xcb_get_geometry_reply_t *g = NULL;
+	if (!p->has_geometry) {
+		_LOG_(ERROR, "cannot get %d geometry", client->window);
+		return -1;
+	}
+
 	if (is_tree_empty(d->tree)) {
 #ifdef _DEBUG__
 		_LOG_(DEBUG,
@@ -5777,64 +6622,58 @@ handle_floating_window(client_t *client, desktop_t *d)
 #endif
 		d->tree			= init_root();
 		d->tree->client = client;
-		g				= get_geometry(client->window, wm->connection);
-		if (g == NULL) {
-			_LOG_(ERROR, "cannot get %d geometry", client->window);
-			return -1;
-		}
-		fill_floating_rectangle(g, &d->tree->floating_rectangle);
+		winmap_put(client->window, d->tree, d, curr_monitor);
+		fill_floating_rectangle(&p->geometry, &d->tree->floating_rectangle);
 		fill_root_rectangle(&d->tree->rectangle);
-		_FREE_(g);
 		d->n_count += 1;
 		update_net_wm_desktop(client->window, d->id);
-		ewmh_update_client_list();
+		mark_dirty(DIRTY_CLIENT_LIST);
 		set_focus(d->tree, true);
 		client->mru_seq = get_next_mru_seq(curr_monitor);
 		int ret			= tile(d->tree);
-		restack();
+		mark_dirty(DIRTY_STACK);
 		return ret;
 	} else {
 		xcb_window_t wi =
-			get_window_under_cursor(wm->connection, wm->root_window);
+			p->has_pointer
+				? p->pointer_child
+				: get_window_under_cursor(wm->connection, wm->root_window);
 		if (wi == wm->root_window || wi == 0) {
-			_FREE_(client);
+			pool_client_free(client);
 			return 0;
 		}
 		node_t *n = find_node_by_window_id(d->tree, wi);
 		n		  = n == NULL ? find_any_leaf(d->tree) : n;
 		if (n == NULL || n->client == NULL) {
-			_FREE_(client);
+			pool_client_free(client);
 			return -1;
 		}
 
 		node_t *new_node = create_node(client);
 		if (new_node == NULL) {
-			_FREE_(client);
+			pool_client_free(client);
 			_LOG_(ERROR, "new node is null");
 			return -1;
 		}
 
-		g = get_geometry(client->window, wm->connection);
-		if (g == NULL) {
-			_LOG_(ERROR, "cannot get %d geometry", client->window);
-			return -1;
-		}
-		fill_floating_rectangle(g, &new_node->floating_rectangle);
+		fill_floating_rectangle(&p->geometry, &new_node->floating_rectangle);
 		new_node->rectangle = new_node->floating_rectangle;
-		_FREE_(g);
 		insert_node(n, new_node, d->layout);
 		d->n_count += 1;
 		update_net_wm_desktop(client->window, d->id);
-		ewmh_update_client_list();
+		mark_dirty(DIRTY_CLIENT_LIST);
 		client->mru_seq = get_next_mru_seq(curr_monitor);
 		int ret			= render_tree(d->tree);
-		restack();
+		mark_dirty(DIRTY_STACK);
 		return ret;
 	}
 }
 
 static int
-insert_into_desktop(int idx, xcb_window_t win, bool is_tiled)
+insert_into_desktop(int					  idx,
+					xcb_window_t		  win,
+					bool				  is_tiled,
+					const window_props_t *p)
 {
 	desktop_t *d = curr_monitor->desktops[--idx];
 	assert(d);
@@ -5852,6 +6691,7 @@ insert_into_desktop(int idx, xcb_window_t win, bool is_tiled)
 	if (!conf.focus_follow_pointer) {
 		window_grab_buttons(client->window);
 	}
+	fill_icccm_ewmh(client, p);
 	/* Keep unmapped clients marked hidden for EWMH consumers. */
 	update_net_wm_desktop(client->window, d->id);
 	set_window_state(client->window, XCB_ICCCM_WM_STATE_ICONIC);
@@ -5859,20 +6699,19 @@ insert_into_desktop(int idx, xcb_window_t win, bool is_tiled)
 		client->window, wm->ewmh->_NET_WM_STATE_HIDDEN, true);
 	update_client_ewmh_state(client, EWMH_STATE_HIDDEN, true);
 	if (client->state == FLOATING) {
-		xcb_get_geometry_reply_t *g = NULL;
+		if (!p->has_geometry) {
+			_LOG_(ERROR, "cannot get %d geometry", client->window);
+			return -1;
+		}
 		if (is_tree_empty(d->tree)) {
 			d->tree			= init_root();
 			d->tree->client = client;
-			g				= get_geometry(client->window, wm->connection);
-			if (g == NULL) {
-				_LOG_(ERROR, "cannot get %d geometry", client->window);
-				return -1;
-			}
-			fill_floating_rectangle(g, &d->tree->floating_rectangle);
+			winmap_put(client->window, d->tree, d, curr_monitor);
+			fill_floating_rectangle(&p->geometry,
+									&d->tree->floating_rectangle);
 			fill_root_rectangle(&d->tree->rectangle);
-			_FREE_(g);
 			d->n_count += 1;
-			ewmh_update_client_list();
+			mark_dirty(DIRTY_CLIENT_LIST);
 		} else {
 			node_t *n = NULL;
 			n		  = find_any_leaf(d->tree);
@@ -5884,21 +6723,16 @@ insert_into_desktop(int idx, xcb_window_t win, bool is_tiled)
 			}
 			node_t *new_node = create_node(client);
 			if (new_node == NULL) {
-				_FREE_(client);
+				pool_client_free(client);
 				_LOG_(ERROR, "new node is null");
 				return -1;
 			}
-			g = get_geometry(client->window, wm->connection);
-			if (g == NULL) {
-				_LOG_(ERROR, "cannot get %d geometry", client->window);
-				return -1;
-			}
-			fill_floating_rectangle(g, &new_node->floating_rectangle);
+			fill_floating_rectangle(&p->geometry,
+									&new_node->floating_rectangle);
 			new_node->rectangle = new_node->floating_rectangle;
-			_FREE_(g);
 			insert_node(n, new_node, d->layout);
 			d->n_count += 1;
-			ewmh_update_client_list();
+			mark_dirty(DIRTY_CLIENT_LIST);
 		}
 	} else {
 		if (is_tree_empty(d->tree)) {
@@ -5907,8 +6741,9 @@ insert_into_desktop(int idx, xcb_window_t win, bool is_tiled)
 			d->tree			   = init_root();
 			d->tree->client	   = client;
 			d->tree->rectangle = r;
+			winmap_put(client->window, d->tree, d, curr_monitor);
 			d->n_count += 1;
-			ewmh_update_client_list();
+			mark_dirty(DIRTY_CLIENT_LIST);
 		} else {
 			node_t *n = NULL;
 			n		  = find_any_leaf(d->tree);
@@ -5924,7 +6759,7 @@ insert_into_desktop(int idx, xcb_window_t win, bool is_tiled)
 			}
 			node_t *new_node = create_node(client);
 			if (new_node == NULL) {
-				_FREE_(client);
+				pool_client_free(client);
 				_LOG_(ERROR, "new node is null");
 				return -1;
 			}
@@ -5933,15 +6768,17 @@ insert_into_desktop(int idx, xcb_window_t win, bool is_tiled)
 			if (d->layout == STACK) {
 				set_focus(new_node, true);
 			}
-			ewmh_update_client_list();
+			mark_dirty(DIRTY_CLIENT_LIST);
 		}
 	}
-	restack();
+	mark_dirty(DIRTY_STACK);
 	return 0;
 }
 
 static int
-handle_tiled_window_request(xcb_window_t win, desktop_t *d)
+handle_tiled_window_request(xcb_window_t		  win,
+							desktop_t			 *d,
+							const window_props_t *p)
 {
 	client_t *client = create_client(win, XCB_ATOM_WINDOW, wm->connection);
 	if (client == NULL) {
@@ -5953,7 +6790,7 @@ handle_tiled_window_request(xcb_window_t win, desktop_t *d)
 	if (!conf.focus_follow_pointer) {
 		window_grab_buttons(client->window);
 	}
-	fill_icccm_ewmh(client);
+	fill_icccm_ewmh(client, p);
 
 	if (is_tree_empty(d->tree)) {
 		return handle_first_window(client, d);
@@ -5963,7 +6800,9 @@ handle_tiled_window_request(xcb_window_t win, desktop_t *d)
 }
 
 static int
-handle_floating_window_request(xcb_window_t win, desktop_t *d)
+handle_floating_window_request(xcb_window_t			 win,
+							   desktop_t			*d,
+							   const window_props_t *p)
 {
 #ifdef _DEBUG__
 	char *name = win_name(win);
@@ -5980,8 +6819,8 @@ handle_floating_window_request(xcb_window_t win, desktop_t *d)
 	if (!conf.focus_follow_pointer) {
 		window_grab_buttons(client->window);
 	}
-	fill_icccm_ewmh(client);
-	return handle_floating_window(client, d);
+	fill_icccm_ewmh(client, p);
+	return handle_floating_window(client, d, p);
 }
 
 static int
@@ -5990,15 +6829,19 @@ handle_map_request(const xcb_event_t *event)
 	xcb_map_request_event_t *ev			= (xcb_map_request_event_t *)event;
 	xcb_window_t			 win		= ev->window;
 	bool					 is_visible = true;
+	window_props_t			 props;
 
-	if (multi_monitors) {
-		monitor_t *mm = get_focused_monitor();
+	prefetch_window_props(win, &props);
+
+	if (multi_monitors && props.has_pointer) {
+		monitor_t *mm =
+			get_monitor_within_coordinate(props.pointer_x, props.pointer_y);
 		if (mm && mm != curr_monitor) {
 			curr_monitor = mm;
 		}
 	}
 
-	if (!should_manage(win, wm->connection)) {
+	if (props.override_redirect) {
 		_LOG_(INFO, "win %d, shouldn't be managed.. ignoring request", win);
 		return 0;
 	}
@@ -6013,7 +6856,7 @@ handle_map_request(const xcb_event_t *event)
 		return 0;
 	}
 
-	rule_t *rule = get_window_rule(win);
+	rule_t *rule = find_window_rule(props.class_name);
 
 	if (rule) {
 		if (rule->desktop_id != -1) {
@@ -6021,7 +6864,7 @@ handle_map_request(const xcb_event_t *event)
 			if (curr_monitor->desk->id != target) {
 				/* Insert into the target desktop, but do not map/focus now */
 				insert_into_desktop(
-					rule->desktop_id, win, rule->state == TILED);
+					rule->desktop_id, win, rule->state == TILED, &props);
 				desktop_t *target_desk = curr_monitor->desktops[target];
 				render_tree_nomap(target_desk->tree);
 				is_visible = false;
@@ -6031,18 +6874,18 @@ handle_map_request(const xcb_event_t *event)
 		}
 		/* for both cases, if a state is specified, use it */
 		if (rule->state == FLOATING) {
-			handle_floating_window_request(win, curr_monitor->desk);
+			handle_floating_window_request(win, curr_monitor->desk, &props);
 			goto out;
 		} else if (rule->state == TILED) {
-			handle_tiled_window_request(win, curr_monitor->desk);
+			handle_tiled_window_request(win, curr_monitor->desk, &props);
 			goto out;
 		}
 	}
 
-	ewmh_window_type_t wint = window_type(win);
+	ewmh_window_type_t wint = props.ewmh_type;
 	if (wint != WINDOW_TYPE_DOCK && wint != WINDOW_TYPE_DESKTOP &&
-		wint != WINDOW_TYPE_NOTIFICATION && apply_floating_hints(win) != -1) {
-		handle_floating_window_request(win, curr_monitor->desk);
+		wint != WINDOW_TYPE_NOTIFICATION && apply_floating_hints(&props) != -1) {
+		handle_floating_window_request(win, curr_monitor->desk, &props);
 		goto out;
 	}
 
@@ -6061,23 +6904,26 @@ handle_map_request(const xcb_event_t *event)
 	case WINDOW_TYPE_NOTIFICATION: return handle_unmanaged_strut_window(win);
 	case WINDOW_TYPE_UNKNOWN:
 	case WINDOW_TYPE_NORMAL:
-		handle_tiled_window_request(win, curr_monitor->desk);
+		handle_tiled_window_request(win, curr_monitor->desk, &props);
 		break;
 	case WINDOW_TYPE_TOOLBAR_MENU:
 	case WINDOW_TYPE_UTILITY:
 	case WINDOW_TYPE_SPLASH:
 	case WINDOW_TYPE_DIALOG:
-		handle_floating_window_request(win, curr_monitor->desk);
+		handle_floating_window_request(win, curr_monitor->desk, &props);
 		break;
 	default: break;
 	}
-out:
+out:;
+	winmap_entry_t *e = winmap_get(win);
+	if (e && e->node && e->node->client) {
+		adopt_transients(e->node->client);
+	}
 	if (conf.focus_follow_spawn && curr_monitor->desk->layout != STACK) {
 		node_t *f = NULL;
 		if ((f = find_node_by_window_id(curr_monitor->desk->tree, win)) ==
 			NULL) {
 			_LOG_(DEBUG, "cannot find window %d, in tree", win);
-			xcb_flush(wm->connection);
 			return -1;
 		}
 		set_focus(f, true);
@@ -6088,8 +6934,7 @@ out:
 	set_window_state(win,
 					 is_visible ? XCB_ICCCM_WM_STATE_NORMAL
 								: XCB_ICCCM_WM_STATE_ICONIC);
-	ewmh_update_client_list();
-	xcb_flush(wm->connection);
+	mark_dirty(DIRTY_CLIENT_LIST);
 
 	return 0;
 }
@@ -6157,10 +7002,10 @@ handle_enter_notify(const xcb_event_t *event)
 
 	if (!conf.focus_follow_pointer) {
 		if (has_floating_window(root)) {
-			restack();
+			mark_dirty(DIRTY_STACK);
 		}
 		if (IS_FULLSCREEN(n->client)) {
-			if (fullscreen_focus(n->client->window)) {
+			if (fullscreen_focus(n->client)) {
 				_LOG_(ERROR, "cannot update win attributes");
 				return -1;
 			}
@@ -6179,19 +7024,19 @@ handle_enter_notify(const xcb_event_t *event)
 	}
 
 	if (IS_FLOATING(n->client)) {
-		if (win_focus(n->client->window, true) != 0) {
+		if (win_focus(n->client, true) != 0) {
 			_LOG_(ERROR, "cannot focus window %d (enter)", n->client->window);
 			return -1;
 		}
 		n->is_focused = true;
 	} else if (IS_FULLSCREEN(n->client)) {
-		if (fullscreen_focus(n->client->window)) {
+		if (fullscreen_focus(n->client)) {
 			_LOG_(ERROR, "cannot update win attributes");
 			return -1;
 		}
 	} else {
 		if (curr_monitor->desk->layout == STACK) {
-			if (win_focus(n->client->window, true) != 0) {
+			if (win_focus(n->client, true) != 0) {
 				_LOG_(
 					ERROR, "cannot focus window %d (enter)", n->client->window);
 				return -1;
@@ -6210,10 +7055,9 @@ handle_enter_notify(const xcb_event_t *event)
 	/*curr_monitor->desk->node = n;*/
 	if (n && n->client) {
 		n->client->mru_seq = get_next_mru_seq(curr_monitor);
-		restack();
+		mark_dirty(DIRTY_STACK);
 	}
 
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -6267,7 +7111,6 @@ handle_leave_notify(const xcb_event_t *event)
 			  client->window);
 		return -1;
 	}
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -6280,8 +7123,23 @@ handle_property_notify(const xcb_event_t *event)
 		/* bar/panel resized or changed reserved space*/
 		if (!ignore_ewmh_struts)
 			recalculate_all_struts();
+	} else if (ev->atom == XCB_ATOM_WM_TRANSIENT_FOR) {
+		node_t *n = find_node_global(ev->window);
+		if (n && n->client) {
+			xcb_window_t			  t = XCB_NONE;
+			xcb_get_property_cookie_t c =
+				xcb_icccm_get_wm_transient_for(wm->connection, ev->window);
+			if (xcb_icccm_get_wm_transient_for_reply(
+					wm->connection, c, &t, NULL) != 1) {
+				t = XCB_NONE;
+			}
+			if (t != n->client->transient_for) {
+				n->client->transient_for = t;
+				link_transient(n->client);
+				mark_dirty(DIRTY_STACK);
+			}
+		}
 	}
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -6312,7 +7170,6 @@ handle_focus_in(const xcb_event_t *event)
 		return 0;
 
 	set_focus(n, true);
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -6334,40 +7191,104 @@ handle_key_press(const xcb_event_t *event)
 		return 0;
 	}
 
+	int (*fn)(arg_t *) = NULL;
+	arg_t *a		   = NULL;
+	if (find_key_binding(cleaned_state, k, &fn, &a)) {
+		if (fn(a) != 0) {
+			_LOG_(ERROR, "error while executing function_ptr(..)");
+		}
+	}
+	return 0;
+}
+
+static inline size_t
+key_slot(uint16_t mod, xcb_keysym_t k)
+{
+	const uint32_t h = (k * 2654435761u) ^ ((uint32_t)mod * 40503u);
+	return (size_t)h & key_table_mask;
+}
+
+/* adds a binding unless (mod, keysym) is already taken, so the first one
+ * inserted wins, like the first match of the old linear scan */
+static void
+key_table_insert(uint32_t mod, xcb_keysym_t k, int (*fn)(arg_t *), arg_t *a)
+{
+	const uint16_t m = (uint16_t)(mod & ~(XCB_MOD_MASK_LOCK));
+	size_t		   i = key_slot(m, k);
+	while (key_table[i].execute) {
+		if (key_table[i].mod == m && key_table[i].keysym == k)
+			return;
+		i = (i + 1) & key_table_mask;
+	}
+	key_table[i] =
+		(key_slot_t){.mod = m, .keysym = k, .execute = fn, .arg = a};
+}
+
+/* build_key_table - hashes the active bindings, the config keys when there
+ * are any, the built-in _keys_[] otherwise. the table is rebuilt with every
+ * grab since that is where the binding set changes */
+static int
+build_key_table(void)
+{
+	size_t n = 0;
 	if (key_head) {
-		conf_key_t *current = key_head;
-		while (current) {
-			if (cleaned_state == (current->mod & ~(XCB_MOD_MASK_LOCK))) {
-				if (current->keysym == k) {
-					arg_t	 *a	  = current->arg;
-					const int ret = current->execute(a);
-					if (ret != 0) {
-						_LOG_(ERROR, "error while executing function_ptr(..)");
-					}
-					break;
-				}
-			}
-			current = current->next;
+		for (conf_key_t *cur = key_head; cur; cur = cur->next) {
+			n++;
 		}
-		return 0;
+	} else {
+		n = LEN(_keys_);
 	}
 
-	size_t n = sizeof(_keys_) / sizeof(_keys_[0]);
-	for (size_t i = n; i--;) {
-		if (cleaned_state == (_keys_[i].mod & ~(XCB_MOD_MASK_LOCK))) {
-			if (_keys_[i].keysym == k) {
-				arg_t	 *a	  = _keys_[i].arg;
-				const int ret = _keys_[i].execute(a);
-				if (ret != 0) {
-					_LOG_(ERROR, "error while executing function_ptr(..)");
-				}
-				break;
-			}
+	/* at most half full, so probes stay short */
+	size_t cap = 16;
+	while (cap < n * 2) {
+		cap <<= 1;
+	}
+	_FREE_(key_table);
+	key_table = calloc(cap, sizeof(key_slot_t));
+	if (key_table == NULL) {
+		_LOG_(ERROR, "failed to allocate key table");
+		key_table_mask = 0;
+		return -1;
+	}
+	key_table_mask = cap - 1;
+
+	if (key_head) {
+		for (conf_key_t *cur = key_head; cur; cur = cur->next) {
+			key_table_insert(cur->mod, cur->keysym, cur->execute, cur->arg);
 		}
+		return 0;
+	}
+	for (size_t i = LEN(_keys_); i--;) {
+		key_table_insert(
+			_keys_[i].mod, _keys_[i].keysym, _keys_[i].execute, _keys_[i].arg);
 	}
 	return 0;
 }
 
+/* looks up the action bound to keysym k under the (lock-cleaned) modifier
+ * state. the config keys replace the built-in _keys_[] when present */
+static bool
+find_key_binding(uint16_t	  state,
+				 xcb_keysym_t k,
+				 int		(**fn)(arg_t *),
+				 arg_t	   **arg)
+{
+	if (key_table == NULL)
+		return false;
+
+	size_t i = key_slot(state, k);
+	while (key_table[i].execute) {
+		if (key_table[i].mod == state && key_table[i].keysym == k) {
+			*fn	 = key_table[i].execute;
+			*arg = key_table[i].arg;
+			return true;
+		}
+		i = (i + 1) & key_table_mask;
+	}
+	return false;
+}
+
 static inline window_state_action_t
 convert_state_action(uint32_t action)
 {
@@ -6380,39 +7301,17 @@ convert_state_action(uint32_t action)
 }
 
 static inline client_message_type_t
-get_client_message_type(xcb_atom_t type, xcb_ewmh_conn_t *ewmh)
+get_client_message_type(xcb_atom_t type)
 {
-	if (type == ewmh->_NET_CURRENT_DESKTOP)
-		return CLIENT_MESSAGE_CURRENT_DESKTOP;
-	if (type == ewmh->_NET_WM_STATE)
-		return CLIENT_MESSAGE_WINDOW_STATE;
-	if (type == ewmh->_NET_ACTIVE_WINDOW)
-		return CLIENT_MESSAGE_ACTIVE_WINDOW;
-	if (type == ewmh->_NET_WM_DESKTOP)
-		return CLIENT_MESSAGE_WINDOW_DESKTOP;
-	if (type == ewmh->_NET_CLOSE_WINDOW)
-		return CLIENT_MESSAGE_CLOSE_WINDOW;
-
-	return CLIENT_MESSAGE_UNSUPPORTED;
+	const atom_entry_t *e = atom_lookup(type);
+	return e ? e->message : CLIENT_MESSAGE_UNSUPPORTED;
 }
 
 window_state_type_t
-get_window_state_type(uint32_t state, xcb_ewmh_conn_t *ewmh)
+get_window_state_type(uint32_t state)
 {
-	if (state == ewmh->_NET_WM_STATE_FULLSCREEN)
-		return STATE_FULLSCREEN;
-	if (state == ewmh->_NET_WM_STATE_BELOW)
-		return STATE_BELOW;
-	if (state == ewmh->_NET_WM_STATE_ABOVE)
-		return STATE_ABOVE;
-	if (state == ewmh->_NET_WM_STATE_HIDDEN)
-		return STATE_HIDDEN;
-	if (state == ewmh->_NET_WM_STATE_STICKY)
-		return STATE_STICKY;
-	if (state == ewmh->_NET_WM_STATE_DEMANDS_ATTENTION)
-		return STATE_DEMANDS_ATTENTION;
-
-	return STATE_UNSUPPORTED;
+	const atom_entry_t *e = atom_lookup(state);
+	return e ? e->state : STATE_UNSUPPORTED;
 }
 
 static int
@@ -6466,7 +7365,7 @@ handle_net_wm_state(xcb_window_t win_event, uint32_t action, uint32_t state)
 	}
 
 	int					  result	   = 0;
-	window_state_type_t	  type		   = get_window_state_type(state, wm->ewmh);
+	window_state_type_t	  type		   = get_window_state_type(state);
 	window_state_action_t state_action = convert_state_action(action);
 	ewmh_state_t		  flag		   = ewmh_flag_for_atom(state);
 	bool				  set_state	   = false;
@@ -6514,7 +7413,7 @@ handle_net_wm_state(xcb_window_t win_event, uint32_t action, uint32_t state)
 	default: break;
 	}
 	if (flag != EWMH_STATE_NONE) {
-		restack();
+		mark_dirty(DIRTY_STACK);
 	}
 
 	_FREE_(name);
@@ -6592,7 +7491,7 @@ handle_net_wm_desktop(xcb_window_t win, uint32_t index)
 		return -1;
 	}
 	if (unlink_node(n, d)) {
-		if (!transfer_node(n, td)) {
+		if (!transfer_node(n, td, curr_monitor)) {
 			_LOG_(ERROR, "could not transfer node.. abort");
 			return -1;
 		}
@@ -6612,8 +7511,9 @@ handle_net_wm_desktop(xcb_window_t win, uint32_t index)
 		arrange_tree(d->tree, d->layout);
 	}
 
-	bool render = curr_monitor->desk == d;
-	return render ? render_tree(d->tree) : 0;
+	if (curr_monitor->desk == d)
+		mark_desktop_dirty(d);
+	return 0;
 }
 
 static int
@@ -6626,7 +7526,7 @@ handle_client_message(const xcb_event_t *event)
 	}
 
 	xcb_window_t		  win	 = ev->window;
-	client_message_type_t type	 = get_client_message_type(ev->type, wm->ewmh);
+	client_message_type_t type	 = get_client_message_type(ev->type);
 	char				 *name	 = win_name(win);
 	int					  result = 0;
 
@@ -6676,7 +7576,6 @@ handle_client_message(const xcb_event_t *event)
 	}
 	_LOG_CLIENT_MESSAGE_(UNKNOWN_EVENT, win, name);
 	_FREE_(name);
-	xcb_flush(wm->connection);
 	return result;
 }
 
@@ -6706,12 +7605,19 @@ handle_unmap_notify(const xcb_event_t *event)
 		return 0;
 	}
 
+	/* the client unmapped itself, the shadow must not claim otherwise if
+	 * the window outlives this (kill_window failing below) */
+	node_t *n = find_node_global(win);
+	if (n && n->client) {
+		n->client->shadow.mapped = false;
+		shadow_writes++;
+	}
+
 	if (kill_window(win) != 0) {
 		_LOG_(ERROR, "cannot kill window %d (unmap)", win);
 		return -1;
 	}
-	ewmh_update_client_list();
-	xcb_flush(wm->connection);
+	mark_dirty(DIRTY_CLIENT_LIST);
 	return 0;
 }
 
@@ -6817,7 +7723,6 @@ handle_configure_request(const xcb_event_t *event)
 					   XCB_EVENT_MASK_STRUCTURE_NOTIFY,
 					   (const char *)&evt);
 	}
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -6851,8 +7756,7 @@ handle_destroy_notify(const xcb_event_t *event)
 		_LOG_(ERROR, "cannot kill window %d (destroy)", win);
 		return -1;
 	}
-	ewmh_update_client_list();
-	xcb_flush(wm->connection);
+	mark_dirty(DIRTY_CLIENT_LIST);
 	return 0;
 }
 
@@ -6972,19 +7876,19 @@ normal_handling:
 	}
 
 	if (IS_FLOATING(n->client)) {
-		if (win_focus(n->client->window, true) != 0) {
+		if (win_focus(n->client, true) != 0) {
 			_LOG_(ERROR, "cannot focus window %d (enter)", n->client->window);
 			return -1;
 		}
 		n->is_focused = true;
 	} else if (IS_FULLSCREEN(n->client)) {
-		if (fullscreen_focus(n->client->window)) {
+		if (fullscreen_focus(n->client)) {
 			_LOG_(ERROR, "cannot update win attributes");
 			return -1;
 		}
 	} else {
 		if (curr_monitor->desk->layout == STACK) {
-			if (win_focus(n->client->window, true) != 0) {
+			if (win_focus(n->client, true) != 0) {
 				_LOG_(
 					ERROR, "cannot focus window %d (enter)", n->client->window);
 				return -1;
@@ -7003,12 +7907,11 @@ normal_handling:
 	/*curr_monitor->desk->node = n;*/
 
 	if (has_floating_window(root)) {
-		restack();
+		mark_dirty(DIRTY_STACK);
 	}
 
 	xcb_allow_events(wm->connection, XCB_ALLOW_SYNC_POINTER, ev->time);
 	/* set_cursor(CURSOR_POINTER); */
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -7022,16 +7925,17 @@ handle_mapping_notify(const xcb_event_t *event)
 		return 0;
 	}
 
-	if (is_kgrabbed) {
-		ungrab_keys(wm->connection, wm->root_window);
-		is_kgrabbed = !is_kgrabbed;
+	numlock_known = false;
+	/* only the keycodes in the event are fetched again */
+	if (ev->request == XCB_MAPPING_KEYBOARD && keymap.syms != NULL &&
+		!fetch_keymap(wm->connection, ev->first_keycode, ev->count)) {
+		_FREE_(keymap.syms); /* fetched whole on next use */
 	}
 
 	if (0 != grab_keys(wm->connection, wm->root_window)) {
 		_LOG_(ERROR, "cannot grab keys");
 		return -1;
 	}
-	xcb_flush(wm->connection);
 	return 0;
 }
 
@@ -7051,7 +7955,7 @@ handle_motion_notify(const xcb_event_t *event)
 	/* handle drag if active */
 	extern drag_state_t drag_state;
 	if (mouse_state.op != MOUSE_OP_NONE) {
-		handle_mouse_motion(ev->root_x, ev->root_y);
+		queue_mouse_motion(ev->root_x, ev->root_y);
 		return 0;
 	}
 	if (drag_state.active) {
@@ -7174,14 +8078,6 @@ handle_event(xcb_event_t *event)
 {
 	uint8_t event_type = event->response_type & ~0x80;
 
-	/* xinerima is ignored here */
-	if (using_xrandr &&
-		event_type == randr_base + XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
-		_LOG_(INFO, "monitor update was requested");
-		handle_monitor_changes();
-		return 0;
-	}
-
 #if 0
 	switch (event_type) {
 #define _EVENT_HANDLER_(type, handler)                                         \
@@ -7199,32 +8095,241 @@ handle_event(xcb_event_t *event)
 	}
 #endif
 
-	size_t n = sizeof(_handlers_) / sizeof(_handlers_[0]);
-	for (size_t i = 0; i < n; i++) {
-		if (_handlers_[i].type == event_type) {
-			return _handlers_[i].handle(event);
+	return dispatch[event_type] ? dispatch[event_type](event) : 0;
+}
+
+/* xinerama has no events, only randr reports monitor changes */
+static int
+handle_screen_change(const xcb_event_t *event)
+{
+	(void)event;
+	_LOG_(INFO, "monitor update was requested");
+	handle_monitor_changes();
+	return 0;
+}
+
+/* build_dispatch_table - must run after the extensions are set up, since
+ * their events land at first_event + offset, which is only known then */
+static void
+build_dispatch_table(void)
+{
+	for (size_t i = 0; i < LEN(_handlers_); i++) {
+		dispatch[_handlers_[i].type] = _handlers_[i].handle;
+	}
+	if (using_xrandr)
+		dispatch[(uint8_t)(randr_base + XCB_RANDR_SCREEN_CHANGE_NOTIFY)] =
+			handle_screen_change;
+	if (using_xsync)
+		dispatch[(uint8_t)(sync_base + XCB_SYNC_ALARM_NOTIFY)] =
+			handle_sync_alarm_notify;
+}
+
+/* events that can be dropped in favour of a later one of the same kind.
+ * anything else is a barrier, since it may change what the earlier events
+ * mean (a window gets mapped, a binding runs, a drag starts...) */
+static bool
+is_coalescable(uint8_t type)
+{
+	switch (type) {
+	case XCB_MOTION_NOTIFY:
+	case XCB_ENTER_NOTIFY:
+	case XCB_LEAVE_NOTIFY:
+	case XCB_CONFIGURE_REQUEST:
+	case XCB_PROPERTY_NOTIFY:
+	case XCB_KEY_RELEASE: return true;
+	default: return false;
+	}
+}
+
+/* bindings whose auto-repeat is collapsed to a single step per batch */
+static bool
+is_repeat_binding(const xcb_key_press_event_t *ev)
+{
+	int (*fn)(arg_t *) = NULL;
+	arg_t	*a		   = NULL;
+	uint16_t state	   = ev->state & ~(XCB_MOD_MASK_LOCK);
+	if (!find_key_binding(
+			state, get_keysym(ev->detail, wm->connection), &fn, &a))
+		return false;
+
+	return fn == dynamic_resize_wrapper || fn == gap_handler ||
+		   fn == shift_floating_window || fn == grow_floating_window ||
+		   fn == shrink_floating_window;
+}
+
+/* copies the fields of an earlier ConfigureRequest that the later one does
+ * not set, so the later request carries both */
+static void
+merge_configure_request(const xcb_configure_request_event_t *from,
+						xcb_configure_request_event_t		*to)
+{
+	const uint16_t m = from->value_mask & ~to->value_mask;
+	if (m & XCB_CONFIG_WINDOW_X)
+		to->x = from->x;
+	if (m & XCB_CONFIG_WINDOW_Y)
+		to->y = from->y;
+	if (m & XCB_CONFIG_WINDOW_WIDTH)
+		to->width = from->width;
+	if (m & XCB_CONFIG_WINDOW_HEIGHT)
+		to->height = from->height;
+	if (m & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+		to->border_width = from->border_width;
+	if (m & XCB_CONFIG_WINDOW_SIBLING)
+		to->sibling = from->sibling;
+	if (m & XCB_CONFIG_WINDOW_STACK_MODE)
+		to->stack_mode = from->stack_mode;
+	to->value_mask |= m;
+}
+
+/* returns true when ev is made redundant by the later event l */
+static bool
+superseded_by(xcb_event_t *ev, xcb_event_t *l)
+{
+	const uint8_t type = ev->response_type & ~0x80;
+	if ((l->response_type & ~0x80) != type)
+		return false;
+
+	switch (type) {
+	case XCB_MOTION_NOTIFY:
+		return ((xcb_motion_notify_event_t *)ev)->event ==
+			   ((xcb_motion_notify_event_t *)l)->event;
+	case XCB_ENTER_NOTIFY: {
+		/* only an enter that handle_enter_notify acts on ends the chain */
+		xcb_enter_notify_event_t *e = (xcb_enter_notify_event_t *)l;
+		return e->mode == XCB_NOTIFY_MODE_NORMAL &&
+			   e->detail != XCB_NOTIFY_DETAIL_INFERIOR;
+	}
+	case XCB_CONFIGURE_REQUEST: {
+		xcb_configure_request_event_t *a = (void *)ev;
+		xcb_configure_request_event_t *b = (void *)l;
+		if (a->window != b->window)
+			return false;
+		merge_configure_request(a, b);
+		return true;
+	}
+	case XCB_PROPERTY_NOTIFY: {
+		/* the handler reads the current value, not the event's */
+		xcb_property_notify_event_t *a = (void *)ev;
+		xcb_property_notify_event_t *b = (void *)l;
+		return a->window == b->window && a->atom == b->atom;
+	}
+	default: return false;
+	}
+}
+
+/* drops events made redundant by a later one in the same batch and
+ * compacts the survivors in order. returns the new length */
+static size_t
+coalesce_events(xcb_event_t **batch, size_t n)
+{
+	size_t barrier = n;
+	for (size_t i = n; i--;) {
+		xcb_event_t	 *ev	= batch[i];
+		const uint8_t type	= ev->response_type & ~0x80;
+		bool		  drop	= false;
+
+		if (type == XCB_KEY_PRESS) {
+			/* auto-repeat: the same key again, with nothing but its own
+			 * releases in between */
+			xcb_key_press_event_t *k = (xcb_key_press_event_t *)ev;
+			size_t				   j = i + 1;
+			while (j < n &&
+				   (!batch[j] ||
+					((batch[j]->response_type & ~0x80) == XCB_KEY_RELEASE &&
+					 ((xcb_key_release_event_t *)batch[j])->detail ==
+						 k->detail)))
+				j++;
+			if (j < n &&
+				(batch[j]->response_type & ~0x80) == XCB_KEY_PRESS) {
+				xcb_key_press_event_t *nk = (xcb_key_press_event_t *)batch[j];
+				drop = nk->detail == k->detail && nk->state == k->state &&
+					   is_repeat_binding(k);
+			}
+		} else if (is_coalescable(type)) {
+			for (size_t j = i + 1; j < barrier && !drop; j++) {
+				if (batch[j])
+					drop = superseded_by(ev, batch[j]);
+			}
+		}
+
+		if (drop) {
+			_FREE_(batch[i]);
+			continue;
 		}
+		if (!is_coalescable(type))
+			barrier = i;
 	}
 
-	return 0;
+	size_t len = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (batch[i])
+			batch[len++] = batch[i];
+	}
+	return len;
+}
+
+static void
+dispatch_event(xcb_event_t *event)
+{
+	if (event->response_type == 0) {
+		handle_x_error((xcb_error_t *)event);
+		return;
+	}
+	if (handle_event(event) != 0) {
+		uint8_t type = event->response_type & ~0x80;
+		char   *es	 = xcb_event_to_string(type);
+		_LOG_(ERROR, "error processing event: %s ", es);
+	}
 }
 
-/* event_loop - the main loop that listens to redirected x events */
+/* blocks until the x connection or the frame timer has something to read.
+ * returns false when the loop should stop */
+static bool
+wait_for_input(xcb_conn_t *conn)
+{
+	struct pollfd fds[2] = {
+		{.fd = xcb_get_file_descriptor(conn), .events = POLLIN},
+		{.fd = frame_timer_fd, .events = POLLIN},
+	};
+	const nfds_t  nfds	 = frame_timer_fd < 0 ? 1 : 2;
+	if (poll(fds, nfds, -1) < 0)
+		return errno == EINTR;
+	if (nfds > 1 && (fds[1].revents & POLLIN)) {
+		on_frame_timer();
+		commit_dirty();
+	}
+	return !(fds[0].revents & (POLLERR | POLLHUP));
+}
+
+/* event_loop - the main loop that listens to redirected x events.
+ * after waiting for one event it drains whatever else is already queued,
+ * so bursts (pointer sweeps, configure floods, key repeat) are coalesced
+ * before anything is dispatched */
 static void
 event_loop(wm_t *w)
 {
+	xcb_event_t *batch[EVENT_BATCH_MAX];
 	xcb_event_t *event;
-	while (!should_shutdown && (event = xcb_wait_for_event(w->connection))) {
-		if (event->response_type == 0) {
-			_FREE_(event);
+	commit_dirty(); /* whatever setup left pending */
+	while (!should_shutdown) {
+		if ((event = xcb_poll_for_event(w->connection)) == NULL) {
+			if (xcb_connection_has_error(w->connection) ||
+				!wait_for_input(w->connection))
+				break;
 			continue;
 		}
-		if (handle_event(event) != 0) {
-			uint8_t type = event->response_type & ~0x80;
-			char   *es	 = xcb_event_to_string(type);
-			_LOG_(ERROR, "error processing event: %s ", es);
+		size_t n   = 0;
+		batch[n++] = event;
+		while (n < EVENT_BATCH_MAX &&
+			   (event = xcb_poll_for_queued_event(w->connection))) {
+			batch[n++] = event;
+		}
+		n = coalesce_events(batch, n);
+		for (size_t i = 0; i < n; i++) {
+			dispatch_event(batch[i]);
+			_FREE_(batch[i]);
 		}
-		_FREE_(event);
+		commit_dirty();
 	}
 }
 
@@ -7239,6 +8344,7 @@ static void
 cleanup(int sig)
 {
 	if (wm != NULL) {
+		_FREE_(keymap.syms);
 		if (wm->connection != NULL) {
 			xcb_disconnect(wm->connection);
 		}
@@ -7252,6 +8358,13 @@ cleanup(int sig)
 	free_rules();
 	cleanup_strut_windows();
 	free_monitors(); /* frees desktops and trees as well */
+	layout_free();
+	pool_log_stats("exit"); /* anything live here leaked */
+	_FREE_(vis_batch);
+	_FREE_(key_table);
+	_FREE_(grabbed_keys);
+	if (frame_timer_fd >= 0)
+		close(frame_timer_fd);
 	_LOG_(INFO, "ZWM exits with signal number %d", sig);
 	/* uncommenting the following line *exit(sig)* prevents the os
 	 * from generating a core dump file when zwm crashes */
@@ -7274,6 +8387,9 @@ main(int argc, char **argv)
 		conf.focus_follow_spawn	  = FOCUS_FOLLOW_SPAWN;
 		conf.virtual_desktops	  = NUMBER_OF_DESKTOPS;
 		conf.restore_last_focus	  = RESTORE_LAST_FOCUS;
+		conf.atomic_transitions	  = ATOMIC_TRANSITIONS;
+		conf.outline_mode		  = OUTLINE_MODE;
+		conf.drag_overlay		  = DRAG_OVERLAY;
 	}
 
 	wm = init_wm();
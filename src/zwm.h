@@ -44,6 +44,8 @@ extern strut_win_node_t  *strut_windows;
 extern bool 			  using_xrandr;
 extern bool 		      using_xinerama;
 extern uint8_t 			  randr_base;
+extern bool 			  using_xsync;
+extern uint8_t 			  sync_base;
 
 
 xcb_window_t get_window_under_cursor(xcb_conn_t *conn, xcb_window_t win);
@@ -58,8 +60,14 @@ xcb_cursor_t get_cursor(cursor_t c);
 char *win_name(xcb_window_t);
 int check_window_map_state(xcb_window_t win, win_map_state_t s);
 int set_visibility(xcb_window_t win, bool is_visible);
+void begin_visibility_batch(void);
+int commit_visibility_batch(void);
 int resize_window(xcb_window_t, uint16_t, uint16_t);
 int move_window(xcb_window_t, int16_t, int16_t);
+int configure_geometry(xcb_window_t, rectangle_t, uint16_t);
+int commit_client_geometry(client_t *, rectangle_t, uint16_t);
+int commit_client_map(client_t *);
+uint32_t shadow_version(void);
 int exec_process(arg_t *arg);
 int layout_handler(arg_t *arg);
 int cycle_win_wrapper(arg_t *arg);
@@ -84,6 +92,11 @@ int set_focus(node_t *n, bool flag);
 int swap_node_wrapper(arg_t *arg);
 int change_state(arg_t *arg);
 uint64_t stack_key(const client_t *c);
+void refresh_client_layer(client_t *c);
+void release_client(client_t *c);
+void mark_dirty(dirty_t what);
+void track_request(xcb_cookie_t cookie, xcb_window_t win, xreq_op_t op);
+void mark_desktop_dirty(desktop_t *d);
 ewmh_window_type_t window_type(xcb_window_t win);
 uint32_t get_next_mru_seq(monitor_t *monitor);
 monitor_t *get_monitor_by_window(xcb_window_t win);